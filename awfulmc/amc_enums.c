@@ -28,3 +28,29 @@ LoopStatus convert_to_loop_status(const char *status) {
         return LOOP_NONE;
     }
 }
+
+const char *convert_from_playback_status(PlaybackStatus status) {
+    switch (status) {
+    case PLAYBACK_PLAYING:
+        return "Playing";
+    case PLAYBACK_PAUSED:
+        return "Paused";
+    case PLAYBACK_STOPPED:
+        return "Stopped";
+    default:
+        return "Disabled";
+    }
+}
+
+const char *convert_from_loop_status(LoopStatus status) {
+    switch (status) {
+    case LOOP_TRACK:
+        return "Track";
+    case LOOP_PLAYLIST:
+        return "Playlist";
+    case LOOP_NONE:
+        return "None";
+    default:
+        return "Disabled";
+    }
+}
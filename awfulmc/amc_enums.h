@@ -18,4 +18,6 @@ typedef enum {
 
 PlaybackStatus convert_to_playback_status(const char *status);
 LoopStatus convert_to_loop_status(const char *status);
+const char *convert_from_playback_status(PlaybackStatus status);
+const char *convert_from_loop_status(LoopStatus status);
 #endif
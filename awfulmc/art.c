@@ -0,0 +1,269 @@
+#include "art.h"
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef enum {
+    ART_LOADING,
+    ART_READY,
+    ART_FAILED,
+} ArtState;
+
+typedef struct {
+    char *url;
+    ArtState state;
+    cairo_surface_t *surface;
+    gsize bytes;
+    GList link;
+} ArtEntry;
+
+typedef struct {
+    ArtCache *cache;
+    char *url;
+    int size;
+    cairo_surface_t *surface;
+} ArtJob;
+
+static void art_entry_free(gpointer data) {
+    ArtEntry *entry = data;
+    if (entry->surface != NULL)
+        cairo_surface_destroy(entry->surface);
+    g_free(entry->url);
+    free(entry);
+}
+
+static GdkPixbuf *load_data_url(const char *url, GError **err) {
+    // data:[<mediatype>][;base64],<data>
+    const char *comma = strchr(url, ',');
+    if (comma == NULL)
+        return NULL;
+
+    gsize len;
+    guchar *data;
+    if (comma - url >= 7 && strncmp(comma - 7, ";base64", 7) == 0) {
+        data = g_base64_decode(comma + 1, &len);
+    } else {
+        data = (guchar *)g_uri_unescape_string(comma + 1, NULL);
+        len = data != NULL ? strlen((char *)data) : 0;
+    }
+    if (data == NULL)
+        return NULL;
+
+    GdkPixbufLoader *loader = gdk_pixbuf_loader_new();
+    GdkPixbuf *pixbuf = NULL;
+    if (gdk_pixbuf_loader_write(loader, data, len, err) && gdk_pixbuf_loader_close(loader, err)) {
+        pixbuf = g_object_ref(gdk_pixbuf_loader_get_pixbuf(loader));
+    } else {
+        gdk_pixbuf_loader_close(loader, NULL);
+    }
+    g_object_unref(loader);
+    g_free(data);
+    return pixbuf;
+}
+
+static GdkPixbuf *load_scaled(const char *url, int size, GError **err) {
+    if (g_str_has_prefix(url, "file://")) {
+        char *path = g_filename_from_uri(url, NULL, err);
+        if (path == NULL)
+            return NULL;
+        GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file_at_scale(path, size, size, true, err);
+        g_free(path);
+        return pixbuf;
+    }
+
+    if (!g_str_has_prefix(url, "data:"))
+        return NULL;
+
+    GdkPixbuf *pixbuf = load_data_url(url, err);
+    if (pixbuf == NULL)
+        return NULL;
+
+    int width = gdk_pixbuf_get_width(pixbuf);
+    int height = gdk_pixbuf_get_height(pixbuf);
+    if (width <= size && height <= size)
+        return pixbuf;
+
+    double scale = MIN((double)size / width, (double)size / height);
+    GdkPixbuf *scaled = gdk_pixbuf_scale_simple(pixbuf, MAX(1, width * scale), MAX(1, height * scale), GDK_INTERP_BILINEAR);
+    g_object_unref(pixbuf);
+    return scaled;
+}
+
+static cairo_surface_t *surface_from_pixbuf(GdkPixbuf *pixbuf) {
+    int width = gdk_pixbuf_get_width(pixbuf);
+    int height = gdk_pixbuf_get_height(pixbuf);
+    int channels = gdk_pixbuf_get_n_channels(pixbuf);
+    int src_stride = gdk_pixbuf_get_rowstride(pixbuf);
+    const guint8 *src = gdk_pixbuf_read_pixels(pixbuf);
+
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(surface);
+        return NULL;
+    }
+
+    // Pixbufs are straight RGB(A) bytes, cairo wants premultiplied native endian ARGB words
+    cairo_surface_flush(surface);
+    unsigned char *dst = cairo_image_surface_get_data(surface);
+    int dst_stride = cairo_image_surface_get_stride(surface);
+    for (int y = 0; y < height; y++) {
+        const guint8 *p = src + y * src_stride;
+        uint32_t *q = (uint32_t *)(dst + y * dst_stride);
+        for (int x = 0; x < width; x++, p += channels) {
+            uint32_t a = channels == 4 ? p[3] : 0xff;
+            uint32_t r = p[0] * a / 0xff;
+            uint32_t g = p[1] * a / 0xff;
+            uint32_t b = p[2] * a / 0xff;
+            q[x] = (a << 24) | (r << 16) | (g << 8) | b;
+        }
+    }
+    cairo_surface_mark_dirty(surface);
+    return surface;
+}
+
+static void evict(ArtCache *cache, ArtEntry *keep) {
+    // Oldest first. An entry evicted while loading just has its result dropped when the job finishes.
+    GList *l = cache->lru.tail;
+    while (cache->bytes > cache->max_bytes && l != NULL) {
+        GList *prev = l->prev;
+        ArtEntry *entry = l->data;
+        if (entry != keep) {
+            g_queue_unlink(&cache->lru, &entry->link);
+            cache->bytes -= entry->bytes;
+            g_hash_table_remove(cache->entries, entry->url);
+        }
+        l = prev;
+    }
+}
+
+static void art_job_free(ArtJob *job) {
+    if (job->surface != NULL)
+        cairo_surface_destroy(job->surface);
+    g_free(job->url);
+    free(job);
+}
+
+static void art_job_finish(ArtCache *cache, ArtJob *job) {
+    ArtEntry *entry = g_hash_table_lookup(cache->entries, job->url);
+    if (entry == NULL || entry->state != ART_LOADING)
+        return;
+
+    if (job->surface == NULL) {
+        entry->state = ART_FAILED;
+        return;
+    }
+
+    gsize surface_bytes = cairo_image_surface_get_stride(job->surface) * cairo_image_surface_get_height(job->surface);
+    entry->state = ART_READY;
+    entry->surface = job->surface;
+    job->surface = NULL;
+    entry->bytes += surface_bytes;
+    cache->bytes += surface_bytes;
+    g_queue_unlink(&cache->lru, &entry->link);
+    g_queue_push_head_link(&cache->lru, &entry->link);
+    evict(cache, entry);
+
+    if (cache->ready != NULL)
+        cache->ready(entry->url, cache->ready_data);
+}
+
+static gboolean art_jobs_finish(gpointer user_data) {
+    ArtCache *cache = user_data;
+
+    g_mutex_lock(&cache->finished_lock);
+    GSList *finished = g_slist_reverse(cache->finished);
+    cache->finished = NULL;
+    cache->finish_source = 0;
+    g_mutex_unlock(&cache->finished_lock);
+
+    for (GSList *l = finished; l != NULL; l = l->next) {
+        art_job_finish(cache, l->data);
+        art_job_free(l->data);
+    }
+    g_slist_free(finished);
+    return G_SOURCE_REMOVE;
+}
+
+static void art_job_run(gpointer data, gpointer user_data) {
+    ArtJob *job = data;
+    GError *err = NULL;
+
+    GdkPixbuf *pixbuf = load_scaled(job->url, job->size, &err);
+    if (pixbuf != NULL) {
+        job->surface = surface_from_pixbuf(pixbuf);
+        g_object_unref(pixbuf);
+    } else if (err != NULL) {
+        g_debug("could not load art %.64s: %s", job->url, err->message);
+        g_error_free(err);
+    }
+
+    // Results are only ever touched on the main loop, one idle source picks up everything finished since
+    // the last time it ran
+    ArtCache *cache = job->cache;
+    g_mutex_lock(&cache->finished_lock);
+    cache->finished = g_slist_prepend(cache->finished, job);
+    if (cache->finish_source == 0)
+        cache->finish_source = g_idle_add(art_jobs_finish, cache);
+    g_mutex_unlock(&cache->finished_lock);
+}
+
+ArtCache *art_cache_new(int size, gsize max_bytes, ArtReadyFunc ready, gpointer ready_data) {
+    ArtCache *cache = calloc(1, sizeof(ArtCache));
+    cache->entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, art_entry_free);
+    g_queue_init(&cache->lru);
+    g_mutex_init(&cache->finished_lock);
+    cache->max_bytes = max_bytes;
+    cache->size = size;
+    cache->ready = ready;
+    cache->ready_data = ready_data;
+    cache->pool = g_thread_pool_new(art_job_run, cache, ART_WORKERS, false, NULL);
+    return cache;
+}
+
+void art_cache_free(ArtCache *cache) {
+    // Drop queued jobs and wait for the running ones so no worker outlives the cache
+    g_thread_pool_free(cache->pool, true, true);
+    // Whatever they finished has not been picked up yet, and must not be once the cache is gone
+    if (cache->finish_source != 0)
+        g_source_remove(cache->finish_source);
+    g_slist_free_full(cache->finished, (GDestroyNotify)art_job_free);
+    g_mutex_clear(&cache->finished_lock);
+    g_hash_table_destroy(cache->entries);
+    free(cache);
+}
+
+cairo_surface_t *art_cache_lookup(ArtCache *cache, const char *url) {
+    ArtEntry *entry = g_hash_table_lookup(cache->entries, url);
+    if (entry != NULL) {
+        g_queue_unlink(&cache->lru, &entry->link);
+        g_queue_push_head_link(&cache->lru, &entry->link);
+        return entry->state == ART_READY ? entry->surface : NULL;
+    }
+
+    // The key alone can be a data: URL of hundreds of kilobytes, so it counts against the budget whatever
+    // becomes of the entry
+    entry = calloc(1, sizeof(ArtEntry));
+    entry->url = g_strdup(url);
+    entry->bytes = strlen(url) + 1;
+    entry->link.data = entry;
+    g_queue_push_head_link(&cache->lru, &entry->link);
+    cache->bytes += entry->bytes;
+    g_hash_table_insert(cache->entries, entry->url, entry);
+
+    if (!g_str_has_prefix(url, "file://") && !g_str_has_prefix(url, "data:")) {
+        entry->state = ART_FAILED;
+        evict(cache, entry);
+        return NULL;
+    }
+
+    entry->state = ART_LOADING;
+    evict(cache, entry);
+
+    ArtJob *job = calloc(1, sizeof(ArtJob));
+    job->cache = cache;
+    job->url = g_strdup(url);
+    job->size = cache->size;
+    g_thread_pool_push(cache->pool, job, NULL);
+    return NULL;
+}
@@ -0,0 +1,35 @@
+#ifndef __ART_H__
+#define __ART_H__
+
+#include "glib.h"
+#include <cairo/cairo.h>
+
+#define ART_SIZE 80
+#define ART_CACHE_BYTES (4 * 1024 * 1024)
+#define ART_WORKERS 2
+
+typedef void (*ArtReadyFunc)(const char *url, gpointer user_data);
+
+// Album art decoded off the main loop into ready to paint surfaces, keyed by mpris:artUrl. Only file://
+// and data: URLs are loaded. Every entry, including ones still loading or that failed, is charged its URL
+// plus its surface and evicted least recently used first once they take up more than max_bytes. ready is
+// called on the main loop whenever a surface becomes available.
+typedef struct {
+    GHashTable *entries;
+    GQueue lru;
+    gsize bytes;
+    gsize max_bytes;
+    int size;
+    GThreadPool *pool;
+    // Jobs the workers are done with, handed to the main loop by finish_source
+    GMutex finished_lock;
+    GSList *finished;
+    guint finish_source;
+    ArtReadyFunc ready;
+    gpointer ready_data;
+} ArtCache;
+
+ArtCache *art_cache_new(int size, gsize max_bytes, ArtReadyFunc ready, gpointer ready_data);
+void art_cache_free(ArtCache *cache);
+cairo_surface_t *art_cache_lookup(ArtCache *cache, const char *url);
+#endif
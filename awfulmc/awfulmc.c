@@ -1,368 +1,280 @@
 #include "awfulmc.h"
 
-#define COMMAND_BUF_SIZE 256
+#define COMMAND_TIMEOUT_MS 1000
+#define LATENCY_BUCKETS 6
+
+// Time from a command arriving (socket read or click) to its message being handed to the bus connection
+static const gint64 latency_bucket_limits[LATENCY_BUCKETS] = { 50, 100, 250, 500, 1000, G_MAXINT64 };
+
+typedef struct {
+    guint64 count;
+    gint64 total;
+    gint64 max;
+    guint64 buckets[LATENCY_BUCKETS];
+} CommandLatency;
 
 GMainLoop *main_loop;
 
+// Everything here belongs to the UI thread. players mirrors the live players of the bus thread, kept up to
+// date from the PlayerDeltas it sends, see apply_delta().
 typedef struct {
     GDBusConnection *con;
-    GQueue *players;
-    GQueue *pending_players;
-    Player *pending_active;
-    int display_fd;
+    BusWorker *bus;
+    PlayerRegistry *players;
     bool media_box_visible;
     MediaBoxContext *mbc;
+    ControlServer *control;
+    ShmPublisher *shm;
+    // Set when a command arrives, consumed by send_mpris_command()
+    gint64 command_received;
+    CommandLatency latency;
+    bool track_replies;
 } AwfulMCContext;
 
 void handle_media_box(AwfulMCContext *ctx) {
     g_debug("media_box_visible=%d", ctx->media_box_visible);
     if (ctx->media_box_visible) {
-        draw_media_box(ctx->mbc, ctx->players);
+        media_box_queue_redraw(ctx->mbc);
     } else {
+        media_box_cancel_redraw(ctx->mbc);
         remove_media_box(ctx->mbc);
         ctx->mbc->shown_player = NULL;
-        ctx->mbc->shown_player_index = 0;
     }
 }
 
-gboolean get_player_properties(AwfulMCContext *ctx, Player* player) {
-    GVariant *reply, *properties;
-    GError *err = NULL;
-
-    reply = g_dbus_connection_call_sync(
-        ctx->con,
-        player->unique,
-        "/org/mpris/MediaPlayer2",
-        "org.freedesktop.DBus.Properties",
-        "GetAll",
-        g_variant_new("(s)", "org.mpris.MediaPlayer2.Player"),
-        NULL,
-        G_DBUS_CALL_FLAGS_NO_AUTO_START,
-        -1,
-        NULL,
-        &err
-    );
-
-    if (err != NULL) {
-        g_printerr("Could not get player properties for player %s: %s", player->name, err->message);
-        g_error_free(err);
-        return FALSE;
-    }
-
-    properties = g_variant_get_child_value(reply, 0);
-    update_player_properties(player, properties);
-    g_variant_unref(properties);
-    g_variant_unref(reply);
-    return TRUE;
+static void context_publish(AwfulMCContext *ctx, GString *event) {
+    if (event->len > 0)
+        control_server_publish(ctx->control, event->str, event->len);
+    g_string_free(event, true);
 }
 
-const gchar *get_player_owner(GDBusConnection *con, const gchar *name) {
-    GError *error = NULL;
-    GVariant *owner_reply = g_dbus_connection_call_sync(
-        con,
-        "org.freedesktop.DBus",
-        "/org/freedesktop/DBus",
-        "org.freedesktop.DBus",
-        "GetNameOwner",
-        g_variant_new("(s)", name),
-        NULL,
-        G_DBUS_CALL_FLAGS_NO_AUTO_START,
-        -1,
-        NULL,
-        &error
-    );
-
-    if (error != NULL) {
-        g_warning("could not get owner for name %s: %s", name, error->message);
-        g_error_free(error);
-        return NULL;
+static void context_add_player(AwfulMCContext *ctx, PlayerDelta *delta) {
+    Player *player = player_new(delta->unique, delta->instance);
+    player_set_properties(player, &delta->properties);
+    player->state = PLAYER_STATE_LIVE;
+    player_registry_add(ctx->players, player);
+    player_registry_set_live(ctx->players, player);
+    if (player->player_properties->playback_status == PLAYBACK_PLAYING)
+        player_registry_touch_playing(ctx->players, player);
+    if (ctx->media_box_visible) {
+        handle_media_box(ctx);
+    }
+    if (ctx->control->subscribers > 0) {
+        GString *event = g_string_new(NULL);
+        event_player_added(event, player);
+        event_player_update(event, player, PLAYER_CHANGED_ALL);
+        context_publish(ctx, event);
     }
-
-    GVariant *owner_reply_value = g_variant_get_child_value(owner_reply, 0);
-    const gchar *owner = g_strdup(g_variant_get_string(owner_reply_value, 0));
-    g_debug("Found owner for %s: %s", name, owner);
-
-    g_variant_unref(owner_reply_value);
-    g_variant_unref(owner_reply);
-    return owner;
 }
 
-GQueue *get_players(AwfulMCContext *ctx, GError **err) {
-    GQueue *players = g_queue_new();
-    GError *tmp_error = NULL;
-
-    GDBusProxy *proxy = g_dbus_proxy_new_sync(
-        ctx->con,
-        G_DBUS_PROXY_FLAGS_NONE,
-        NULL,
-        "org.freedesktop.DBus",
-        "/org/freedesktop/DBus",
-        "org.freedesktop.DBus",
-        NULL,
-        &tmp_error
-    );
-
-    if (tmp_error != NULL) {
-        g_warning("Could not create the proxy when getting player names");
-        g_propagate_error(err, tmp_error);
-        return NULL;
+static void context_remove_player(AwfulMCContext *ctx, Player *player) {
+    if (ctx->control->subscribers > 0) {
+        GString *event = g_string_new(NULL);
+        event_player_removed(event, player);
+        context_publish(ctx, event);
     }
-
-    g_info("Getting list of player names from D-Bus");
-    GVariant *reply = g_dbus_proxy_call_sync(
-        proxy,
-        "ListNames",
-        NULL,
-        G_DBUS_CALL_FLAGS_NONE,
-        -1,
-        NULL,
-        &tmp_error
-    );
-
-    if (tmp_error != NULL) {
-        g_object_unref(proxy);
-        g_propagate_error(err, tmp_error);
-        return NULL;
+    if (ctx->mbc->shown_player == player) {
+        // Show the neighbour that takes its place in the carousel
+        GList *neighbour = player->live_link.prev != NULL ? player->live_link.prev : player->live_link.next;
+        ctx->mbc->shown_player = neighbour != NULL ? neighbour->data : NULL;
     }
+    player_registry_remove(ctx->players, player);
+    media_box_forget_player(ctx->mbc, player);
+    player_free(player);
+    handle_media_box(ctx);
+}
 
-    GVariant *reply_child = g_variant_get_child_value(reply, 0);
-    gsize reply_count;
-    const gchar **names = g_variant_get_strv(reply_child, &reply_count);
-
-    size_t offset = strlen(MPRIS_PREFIX);
-    for (gsize i = 0; i < reply_count; i++) {
-        if (g_str_has_prefix(names[i], MPRIS_PREFIX)) {
-
-            const gchar *owner = get_player_owner(ctx->con, names[i]);
-            if (owner == NULL) {
-                g_warning("Discarding player %s because we could not get owner", names[i]);
-                continue;
-            }
-
-            Player *player = player_new(owner, names[i]+offset);
-
-            if (!get_player_properties(ctx, player)) {
-                g_warning("Discarding player %s because we could not get the properties", player->name);
-                player_free(player);
-                continue;
-            }
-
-            g_queue_push_head(players, player);
-        }
+// Fans a change of a live player out to the media box and to subscribers
+static void context_player_changed(AwfulMCContext *ctx, Player *player, PlayerChanges changes) {
+    if ((changes & PLAYER_CHANGED_PLAYBACK_STATUS) && player->player_properties->playback_status == PLAYBACK_PLAYING)
+        player_registry_touch_playing(ctx->players, player);
+
+    // The back buffer keeps the drawn player while hidden, so its damage is tracked even then
+    if (player == ctx->mbc->drawn_player)
+        media_box_damage(ctx->mbc, media_box_damage_for_changes(changes));
+    if (player == ctx->mbc->shown_player)
+        handle_media_box(ctx);
+
+    if (ctx->control->subscribers > 0) {
+        GString *event = g_string_new(NULL);
+        event_player_update(event, player, changes);
+        context_publish(ctx, event);
     }
-    g_info("Found %u players on the bus.", g_queue_get_length(players));
-
-    g_object_unref(proxy);
-    g_variant_unref(reply);
-    g_variant_unref(reply_child);
-    g_free(names);
-    return players;
 }
 
-static Player *context_find_player(AwfulMCContext *ctx, const char *unique, const char *name, const char *instance) {
-    const Player find_name = {
-        .unique = (char *)unique,
-        .name = (char *)name,
-        .instance = (char *)instance,
-    };
-    GList *found = g_queue_find_custom(ctx->players, &find_name, player_compare);
-    if (found != NULL) {
-        return (Player *)found->data;
+static void context_snapshot(ControlClient *client, gpointer user_data) {
+    AwfulMCContext *ctx = user_data;
+    GString *event = g_string_new(NULL);
+    for (GList *l = ctx->players->live.head; l != NULL; l = l->next) {
+        g_string_truncate(event, 0);
+        event_player_added(event, l->data);
+        event_player_update(event, l->data, PLAYER_CHANGED_ALL);
+        control_client_send_event(client, event->str, event->len);
     }
+    g_string_free(event, true);
+}
 
-    found = g_queue_find_custom(ctx->pending_players, &find_name, player_compare);
-    if (found != NULL) {
-        return (Player *)found->data;
+// Returns whether the shm snapshot needs rewriting
+static bool apply_delta(AwfulMCContext *ctx, PlayerDelta *delta) {
+    Player *player = player_registry_find_instance(ctx->players, delta->instance);
+    if (delta->kind == PLAYER_DELTA_ADDED) {
+        // The bus side only sends ADDED once per appearance, an old copy would mean a REMOVED went missing
+        if (player != NULL)
+            context_remove_player(ctx, player);
+        context_add_player(ctx, delta);
+        return true;
     }
+    if (player == NULL)
+        return false;
 
-    return NULL;
+    switch (delta->kind) {
+    case PLAYER_DELTA_CHANGED:
+        player_set_properties(player, &delta->properties);
+        context_player_changed(ctx, player, delta->changes);
+        return true;
+    case PLAYER_DELTA_OWNER:
+        // Commands go to the unique name, so the mirror has to follow the owner
+        player_registry_set_unique(ctx->players, player, delta->unique);
+        return false;
+    case PLAYER_DELTA_REMOVED:
+        context_remove_player(ctx, player);
+        return true;
+    default:
+        return false;
+    }
 }
 
-void print_players(AwfulMCContext *ctx) {
-    for (guint i = 0; i < g_queue_get_length(ctx->players); i++) {
-        Player *player = g_queue_peek_nth(ctx->players, i);
-        print_player(player);
-        printf("\n");
-    }
-    fflush(stdout);
+// Drains everything the bus thread queued, the snapshot is rewritten once per batch rather than per delta
+static gboolean bus_deltas_callback(gint fd, GIOCondition condition, gpointer user_data) {
+    AwfulMCContext *ctx = user_data;
+    SpscRing *ring = ctx->bus->ring;
+    bool publish = false;
+
+    spsc_ring_ack(ring);
+    do {
+        PlayerDelta *delta;
+        while ((delta = spsc_ring_pop(ring)) != NULL) {
+            publish |= apply_delta(ctx, delta);
+            player_delta_free(delta);
+        }
+    } while (!spsc_ring_sleep(ring));
+    // The bus thread may have been holding deltas back for lack of room
+    spsc_ring_signal_space(ring);
+
+    if (publish)
+        shm_publish(ctx->shm, ctx->players);
+    return G_SOURCE_CONTINUE;
 }
 
 void rotate_shown_player_prev(void *data) {
     AwfulMCContext *ctx = data;
-    guint player_count = g_queue_get_length(ctx->players);
-    if (player_count < 1)
-        return;
-
-    ctx->mbc->shown_player_index = (ctx->mbc->shown_player_index - 1) % player_count;
+    ctx->mbc->shown_player = player_registry_prev(ctx->players, ctx->mbc->shown_player);
 }
 
 void rotate_shown_player_next(void *data) {
     AwfulMCContext *ctx = data;
-    guint player_count = g_queue_get_length(ctx->players);
-    if (player_count < 1)
+    ctx->mbc->shown_player = player_registry_next(ctx->players, ctx->mbc->shown_player);
+}
+
+static void record_command_latency(AwfulMCContext *ctx) {
+    if (ctx->command_received == 0)
         return;
 
-    ctx->mbc->shown_player_index = (ctx->mbc->shown_player_index + 1) % player_count;
+    gint64 latency = g_get_monotonic_time() - ctx->command_received;
+    ctx->command_received = 0;
+
+    CommandLatency *stats = &ctx->latency;
+    stats->count++;
+    stats->total += latency;
+    stats->max = MAX(stats->max, latency);
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        if (latency < latency_bucket_limits[i]) {
+            stats->buckets[i]++;
+            break;
+        }
+    }
+    g_debug("command dispatched in %" G_GINT64_FORMAT "us", latency);
 }
 
-void send_mpris_command(AwfulMCContext *ctx, const char *instance, const char *command) {
-    char service_name[256];
-    snprintf(service_name, sizeof(service_name), "org.mpris.MediaPlayer2.%s", instance);
+static void print_command_latency(AwfulMCContext *ctx) {
+    CommandLatency *stats = &ctx->latency;
+    if (stats->count == 0)
+        return;
 
-    GDBusMessage *msg = g_dbus_message_new_method_call(service_name, "/org/mpris/MediaPlayer2", "org.mpris.MediaPlayer2.Player", command);
-    g_dbus_connection_send_message(ctx->con, msg, G_DBUS_SEND_MESSAGE_FLAGS_NONE, NULL, NULL);
+    g_info("command latency: n=%" G_GUINT64_FORMAT " avg=%" G_GINT64_FORMAT "us max=%" G_GINT64_FORMAT "us "
+           "<50us=%" G_GUINT64_FORMAT " <100us=%" G_GUINT64_FORMAT " <250us=%" G_GUINT64_FORMAT
+           " <500us=%" G_GUINT64_FORMAT " <1ms=%" G_GUINT64_FORMAT " >=1ms=%" G_GUINT64_FORMAT,
+           stats->count, stats->total / (gint64)stats->count, stats->max,
+           stats->buckets[0], stats->buckets[1], stats->buckets[2], stats->buckets[3], stats->buckets[4], stats->buckets[5]);
+}
+
+typedef struct {
+    const char *command;
+    gint64 sent;
+} CommandReply;
+
+static void command_reply_callback(GObject *source, GAsyncResult *res, gpointer user_data) {
+    CommandReply *reply = user_data;
+    GError *err = NULL;
+
+    GDBusMessage *msg = g_dbus_connection_send_message_with_reply_finish(G_DBUS_CONNECTION(source), res, &err);
+    if (msg != NULL && !g_dbus_message_to_gerror(msg, &err)) {
+        g_info("%s answered in %" G_GINT64_FORMAT "us", reply->command, g_get_monotonic_time() - reply->sent);
+    }
+    if (err != NULL) {
+        if (!g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            g_warning("%s failed: %s", reply->command, err->message);
+        g_error_free(err);
+    }
+    if (msg != NULL)
+        g_object_unref(msg);
+    free(reply);
+}
+
+// Addressed to the unique name we already track, so the bus does not have to resolve the well-known one.
+// Replies are only asked for when tracking them, otherwise the player does not even send one.
+void send_mpris_command(AwfulMCContext *ctx, Player *player, const char *command) {
+    GDBusMessage *msg = g_dbus_message_new_method_call(player->unique, "/org/mpris/MediaPlayer2", "org.mpris.MediaPlayer2.Player", command);
+
+    if (ctx->track_replies) {
+        CommandReply *reply = calloc(1, sizeof(CommandReply));
+        reply->command = command;
+        reply->sent = g_get_monotonic_time();
+        g_dbus_connection_send_message_with_reply(ctx->con, msg, G_DBUS_SEND_MESSAGE_FLAGS_NONE, COMMAND_TIMEOUT_MS, NULL,
+                                                  player->cancellable, command_reply_callback, reply);
+    } else {
+        g_dbus_message_set_flags(msg, G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED);
+        g_dbus_connection_send_message(ctx->con, msg, G_DBUS_SEND_MESSAGE_FLAGS_NONE, NULL, NULL);
+    }
+    g_object_unref(msg);
+    record_command_latency(ctx);
 }
 
 void send_play_pause(void *data) {
     AwfulMCContext *ctx = data;
-    send_mpris_command(ctx, ctx->mbc->shown_player->instance, "PlayPause");
+    send_mpris_command(ctx, ctx->mbc->shown_player, "PlayPause");
 }
 
 void send_prev(void *data) {
     AwfulMCContext *ctx = data;
-    send_mpris_command(ctx, ctx->mbc->shown_player->instance, "Previous");
+    send_mpris_command(ctx, ctx->mbc->shown_player, "Previous");
 }
 
 void send_next(void *data) {
     AwfulMCContext *ctx = data;
-    send_mpris_command(ctx, ctx->mbc->shown_player->instance, "Next");
+    send_mpris_command(ctx, ctx->mbc->shown_player, "Next");
 }
 
-static gboolean media_box_callback(GIOChannel *source, GIOCondition condition, gpointer user_data) {
+// Installed as the media box click handler, the backends only hit test
+static void button_clicked(MediaBoxContext *mbc, Button *btn, gpointer user_data) {
     AwfulMCContext *ctx = (AwfulMCContext *)user_data;
-
-    while (XPending(ctx->mbc->display) > 0) {
-        XEvent event;
-        XNextEvent(ctx->mbc->display, &event);
-
-        if (event.type == Expose) {
-            draw_media_box(ctx->mbc, ctx->players);
-        } else if (event.type == ButtonPress) {
-            XButtonEvent *button_event = (XButtonEvent *)&event;
-            for (int i = 0; i < BUTTON_COUNT; i++) {
-                Button *btn = ctx->mbc->buttons[i];
-                if (!btn->displayed)
-                    continue;
-
-                if (button_event->x >= btn->x && button_event->x <= (btn->x + btn->width) && button_event->y >= btn->y && button_event->y <= (btn->y + btn->height)) {
-                    g_info("Button %s clicked.", btn->label);
-                    if (btn->on_click) {
-                        btn->on_click(ctx);
-                        draw_media_box(ctx->mbc, ctx->players);
-                    }
-                    break;
-                }
-            }
-        }
-    }
-
-    return true;
-}
-
-void player_signal_proxy_callback(GDBusConnection *con, const gchar *sender_name, const gchar *object_path, const gchar *interface_name, const gchar *signal_name, GVariant *parameters, gpointer user_data) {
-    AwfulMCContext *ctx = user_data;
-    Player *player = context_find_player(ctx, sender_name, NULL, NULL);
-    bool changed = false;
-
-    if (player == NULL)
-        return;
-
-    if (g_strcmp0(interface_name, "org.mpris.MediaPlayer2.Player") != 0 && g_strcmp0(interface_name, "org.freedesktop.DBus.Properties") != 0)
-        return;
-
-    gchar *p = g_variant_print(parameters, true);
-    g_debug("got player signal: sender=%s, object_path=%s, interface_name=%s, signal_name=%s, parameters=%s", sender_name, object_path, interface_name, signal_name, p);
-    g_free(p);
-
-    if (player == ctx->pending_active)
-        return;
-
-    if (g_strcmp0(signal_name, "PropertiesChanged") == 0) {
-        GVariant *properties = g_variant_get_child_value(parameters, 1);
-        changed = update_player_properties(player, properties);
-        g_variant_unref(properties);
-    }
-
-    if (changed) {
-        g_info("Player %s Properties Changed", player->name);
-        if (player == ctx->mbc->shown_player) {
-            handle_media_box(ctx);
-        }
-    }
-
-    return;
-}
-
-void name_owner_changed_signal_callback(GDBusConnection *con, const gchar *sender_name, const gchar *object_path, const gchar *interface_name, const gchar *signal_name, GVariant *parameters, gpointer user_data) {
-    AwfulMCContext *ctx = user_data;
-    GVariant *name_variant = g_variant_get_child_value(parameters, 0);
-    GVariant *new_owner_variant = g_variant_get_child_value(parameters, 2);
-    const gchar *name = g_variant_get_string(name_variant, 0);
-    const gchar *new_owner = g_variant_get_string(new_owner_variant, 0);
-
-    if (!g_str_has_prefix(name, "org.mpris.MediaPlayer2.")) {
-        g_variant_unref(name_variant);
-        g_variant_unref(new_owner_variant);
+    if (btn->on_click == NULL)
         return;
-    }
-
-    g_debug("got name owner changed signal: name='%s', 'owner'%s'", name, new_owner);
-
-    gsize name_offset = strlen(MPRIS_PREFIX);
-    if (strlen(new_owner) > 0) {
-        g_debug("player name appeared: unique=%s, name=%s", new_owner, name);
-        Player *player = context_find_player(ctx, NULL, NULL, name+name_offset);
-        if (player != NULL) {
-            g_debug("player already managed, updating name");
-            g_free(player->unique);
-            player->unique = g_strdup(name);
-            g_variant_unref(name_variant);
-            g_variant_unref(new_owner_variant);
-            return;
-        }
-
-        g_debug("getting properties for new player");
-        player = player_new(new_owner, name+name_offset);
-        g_queue_remove(ctx->players, player);
-        g_queue_remove(ctx->pending_players, player);
-        g_queue_push_tail(ctx->pending_players, player);
-        ctx->pending_active = player;
-        get_player_properties(ctx, player);
-        g_queue_remove(ctx->pending_players, player);
-        g_queue_push_tail(ctx->players, player);
-        ctx->pending_active = NULL;
-    } else {
-        Player *player = context_find_player(ctx, NULL, NULL, name+name_offset);
-        if (player == NULL) {
-            g_debug("name '%s' not found in queue", name+name_offset);
-            g_variant_unref(name_variant);
-            g_variant_unref(new_owner_variant);
-            return;
-        }
-
-        g_debug("removing name from players: unique=%s, name=%s", player->unique, player->name);
-        g_queue_remove(ctx->players, player);
-        g_queue_remove(ctx->pending_players, player);
-        if (ctx->pending_active == player) {
-            ctx->pending_active = NULL;
-        }
-        if (ctx->mbc->shown_player == player) {
-            if (ctx->mbc->shown_player_index > 0) {
-                ctx->mbc->shown_player_index--;
-            } else {
-                ctx->mbc->shown_player_index = 0;
-            }
-            ctx->mbc->shown_player = NULL;
-            handle_media_box(ctx);
-        }
-        player_free(player);
-    }
 
+    ctx->command_received = g_get_monotonic_time();
+    btn->on_click(ctx);
+    ctx->command_received = 0;
     handle_media_box(ctx);
-
-    g_variant_unref(name_variant);
-    g_variant_unref(new_owner_variant);
-    return;
 }
 
 void handle_exit_signal(int signal) {
@@ -372,91 +284,88 @@ void handle_exit_signal(int signal) {
     }
 }
 
-int create_unix_socket() {
-    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (fd == -1) {
-        perror("socket creation failed");
-        exit(-1);
-    }
-
-    struct sockaddr_un addr = {0};
-    addr.sun_family = AF_UNIX;
-    strncpy(addr.sun_path, SOCKET_PATH, sizeof(addr.sun_path) - 1);
-
-    unlink(SOCKET_PATH);
-    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
-        perror("socket bind failed");
-        close(fd);
-        exit(-1);
-    }
-
-    if (listen(fd, 1) == -1) {
-        perror("socket listen failed");
-        close(fd);
-        exit(-1);
-    }
-    return fd;
+static bool player_shown(AwfulMCContext *ctx) {
+    return ctx->media_box_visible && ctx->mbc->shown_player != NULL;
 }
 
-gboolean unix_socket_callback(GIOChannel *channel, GIOCondition condition, gpointer user_data) {
-    if (condition & (G_IO_HUP | G_IO_ERR | G_IO_NVAL)) {
-        fprintf(stderr, "Socket error or hangup\n");
-        g_io_channel_unref(channel);
-        return false;;
+// Commands that go straight to a player and never touch the media box
+static const struct {
+    const char *command;
+    const char *method;
+} player_commands[] = {
+    { "PLAYPAUSE", "PlayPause" },
+    { "PREVIOUS", "Previous" },
+    { "NEXT", "Next" },
+};
+
+// Matches "COMMAND" and "COMMAND <argument>", arg is set to NULL for the former
+static bool command_matches(const char *line, const char *command, const char **arg) {
+    size_t len = strlen(command);
+    if (strncmp(line, command, len) != 0)
+        return false;
+    if (line[len] == '\0') {
+        *arg = NULL;
+        return true;
     }
+    if (line[len] != ' ')
+        return false;
+    *arg = line + len + 1;
+    return true;
+}
 
-    AwfulMCContext *ctx = (AwfulMCContext *)user_data;
-
-    char buffer[COMMAND_BUF_SIZE] = {0};
-    gsize bytes_read;
-    GIOStatus status = g_io_channel_read_chars(channel, buffer, COMMAND_BUF_SIZE - 1, &bytes_read, NULL);
-
-    if (status == G_IO_STATUS_NORMAL && bytes_read > 0) {
-        buffer[bytes_read] = '\0';
-        if (strncmp(buffer, "TOGGLE\n", bytes_read) == 0) {
-            ctx->media_box_visible = !ctx->media_box_visible;
-            handle_media_box(ctx);
-        } else if (strncmp(buffer, "PLAYPAUSE\n", bytes_read) == 0) {
-            if (ctx->media_box_visible && ctx->mbc->shown_player != NULL) {
-                send_play_pause(ctx);
-            }
-        } else if (strncmp(buffer, "ROTATE\n", bytes_read) == 0) {
-            if (ctx->media_box_visible) {
-                rotate_shown_player_next(ctx);
-                handle_media_box(ctx);
-            }
-        } else if (strncmp(buffer, "PREVIOUS\n", bytes_read) == 0) {
-            if (ctx->media_box_visible && ctx->mbc->shown_player != NULL) {
-                send_prev(ctx);
-            }
-        } else if (strncmp(buffer, "NEXT\n", bytes_read) == 0) {
-            if (ctx->media_box_visible && ctx->mbc->shown_player != NULL) {
-                send_next(ctx);
-            }
-        } else {
-            fprintf(stderr, "Unknown command: %s\n", buffer);
-        }
+// A named instance wins, then the player the visible box shows, then the one that most recently started
+// playing. Only the registry is consulted, so a hidden box stays hidden and nothing gets drawn.
+static Player *command_target(AwfulMCContext *ctx, const char *instance, const char **error) {
+    Player *player;
+    if (instance != NULL) {
+        if (g_str_has_prefix(instance, MPRIS_PREFIX))
+            instance += strlen(MPRIS_PREFIX);
+        player = player_registry_find_instance(ctx->players, instance);
+        if (player == NULL)
+            *error = "no such player";
+        return player;
     }
 
-    int client_fd = g_io_channel_unix_get_fd(channel);
-    close(client_fd);
-    g_io_channel_unref(channel);
-    return false;
+    player = player_shown(ctx) ? ctx->mbc->shown_player : player_registry_active(ctx->players);
+    if (player == NULL)
+        *error = "no players";
+    return player;
 }
 
-gboolean accept_client_connection(GIOChannel *channel, GIOCondition condition, gpointer user_data) {
-    int fd = g_io_channel_unix_get_fd(channel);
-    int client = accept(fd, NULL, NULL);
-    if (client == -1) {
-        perror("Could not accept client connection");
-        return true;
+// Called by the control server once per received line, see control.h
+static const char *handle_command(const char *line, gpointer user_data) {
+    AwfulMCContext *ctx = (AwfulMCContext *)user_data;
+    ctx->command_received = ctx->control->received;
+
+    for (size_t i = 0; i < G_N_ELEMENTS(player_commands); i++) {
+        const char *instance;
+        if (!command_matches(line, player_commands[i].command, &instance))
+            continue;
+
+        const char *error = NULL;
+        Player *player = command_target(ctx, instance, &error);
+        if (player == NULL)
+            return error;
+        send_mpris_command(ctx, player, player_commands[i].method);
+        return NULL;
     }
 
-    GIOChannel *client_channel = g_io_channel_unix_new(client);
-    g_io_channel_set_flags(client_channel, G_IO_FLAG_NONBLOCK, NULL);
-    g_io_add_watch(client_channel, G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL, unix_socket_callback, user_data);
-
-    return true;
+    if (strcmp(line, "TOGGLE") == 0) {
+        ctx->media_box_visible = !ctx->media_box_visible;
+        handle_media_box(ctx);
+    } else if (strcmp(line, "ROTATE") == 0) {
+        if (!ctx->media_box_visible)
+            return "media box not visible";
+        rotate_shown_player_next(ctx);
+        handle_media_box(ctx);
+    } else if (strcmp(line, "STATS") == 0) {
+        print_command_latency(ctx);
+        media_box_print_stats(ctx->mbc);
+    } else {
+        g_warning("unknown command: %s", line);
+        return "unknown command";
+    }
+    return NULL;
 }
 
 int main(void) {
@@ -465,71 +374,78 @@ int main(void) {
     GError *err = NULL;
 
     ctx.media_box_visible = false;
-    ctx.mbc = media_box_context_new();
+    ctx.players = player_registry_new();
+    ctx.mbc = NULL;
+#ifdef HAVE_XCB
+    // XCB unless asked otherwise, Xlib stays as the fallback when it cannot connect
+    if (g_strcmp0(g_getenv("AWFULMC_BACKEND"), "xlib") != 0) {
+        ctx.mbc = media_box_context_new(ctx.players, &media_box_xcb_backend);
+        if (ctx.mbc == NULL)
+            g_warning("could not open the xcb media box, falling back to xlib");
+    }
+#endif
+    if (ctx.mbc == NULL)
+        ctx.mbc = media_box_context_new(ctx.players, &media_box_xlib_backend);
+    if (ctx.mbc == NULL) {
+        return -1;
+    }
+    ctx.mbc->clicked = button_clicked;
+    ctx.mbc->clicked_data = &ctx;
 
-    int fd = create_unix_socket();
-    GIOChannel *server_channel = g_io_channel_unix_new(fd);
-    g_io_channel_set_flags(server_channel, G_IO_FLAG_NONBLOCK, NULL);
-    g_io_add_watch(server_channel, G_IO_IN, accept_client_connection, &ctx);
+    ctx.track_replies = g_strcmp0(g_getenv("AWFULMC_TRACK_REPLIES"), "1") == 0;
 
-    ctx.con = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &err);
-    if (err != NULL) {
-        g_printerr("could not connect to session message bus: %s", err->message);
+    const char *max_fps = g_getenv("AWFULMC_MAX_FPS");
+    if (max_fps != NULL) {
+        media_box_set_max_fps(ctx.mbc, atoi(max_fps));
+    }
+
+    // Fonts, glyphs and surfaces get set up while idle instead of on the first TOGGLE
+    if (g_strcmp0(g_getenv("AWFULMC_WARMUP"), "0") != 0) {
+        media_box_warm_up(ctx.mbc);
+    }
+
+    // Overridable so a benchmark or a second instance does not take over the user's socket and snapshot
+    const char *socket_path = g_getenv("AWFULMC_SOCKET");
+    ctx.control = control_server_new(socket_path != NULL ? socket_path : SOCKET_PATH, handle_command, context_snapshot, &ctx);
+    if (ctx.control == NULL) {
         return -1;
     }
 
-    g_debug("connected to dbus: %s", g_dbus_connection_get_unique_name(ctx.con));
+    // Readers simply see no players if this fails, the rest of the daemon does not depend on it
+    const char *shm_name = g_getenv("AWFULMC_SHM");
+    ctx.shm = shm_publisher_new(shm_name != NULL ? shm_name : AMC_SHM_NAME);
+    if (ctx.shm == NULL) {
+        g_warning("could not create the shared memory snapshot, shm readers will not be updated");
+    }
 
-    ctx.players = get_players(&ctx, &err);
-    ctx.pending_players = g_queue_new();
+    ctx.con = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &err);
     if (err != NULL) {
-        g_printerr("Could not list currently active players: %s", err->message);
-        g_object_unref(ctx.con);
+        g_printerr("could not connect to session message bus: %s", err->message);
         return -1;
     }
 
-    ctx.display_fd = ConnectionNumber(ctx.mbc->display);
-    GIOChannel *channel = g_io_channel_unix_new(ctx.display_fd);
-    g_io_add_watch(channel, G_IO_IN, media_box_callback, &ctx);
+    g_debug("connected to dbus: %s", g_dbus_connection_get_unique_name(ctx.con));
 
     main_loop = g_main_loop_new(NULL, false);
 
-    g_dbus_connection_signal_subscribe(
-        ctx.con,
-        "org.freedesktop.DBus",
-        "org.freedesktop.DBus",
-        "NameOwnerChanged",
-        "/org/freedesktop/DBus",
-        NULL,
-        G_DBUS_SIGNAL_FLAGS_NONE,
-        name_owner_changed_signal_callback,
-        &ctx,
-        NULL);
-
-    g_dbus_connection_signal_subscribe(
-        ctx.con,
-        NULL,
-        NULL,
-        NULL,
-        "/org/mpris/MediaPlayer2",
-        NULL,
-        G_DBUS_SIGNAL_FLAGS_NONE,
-        player_signal_proxy_callback,
-        &ctx,
-        NULL);
-
-    print_players(&ctx);
+    // Bus traffic is handled on its own thread, this one only renders, takes input and sends commands
+    ctx.bus = bus_worker_new(ctx.con, main_loop);
+    if (ctx.bus == NULL) {
+        return -1;
+    }
+    guint bus_watch = g_unix_fd_add(ctx.bus->ring->fd, G_IO_IN, bus_deltas_callback, &ctx);
 
     signal(SIGINT, handle_exit_signal);
     signal(SIGTERM, handle_exit_signal);
     g_main_loop_run(main_loop);
+    g_source_remove(bus_watch);
+    bus_worker_free(ctx.bus);
     g_main_loop_unref(main_loop);
-    g_io_channel_unref(channel);
-    g_io_channel_unref(server_channel);
-    close(fd);
-    unlink(SOCKET_PATH);
+    print_command_latency(&ctx);
+    control_server_free(ctx.control);
+    shm_publisher_free(ctx.shm);
 
-    g_queue_free_full(ctx.players, (GDestroyNotify)player_free);
+    player_registry_free(ctx.players);
     media_box_context_free(ctx.mbc);
     g_object_unref(ctx.con);
     return 0;
@@ -4,6 +4,11 @@
 #include "pango/pango-font.h"
 #include "pango/pango-layout.h"
 #include "player.h"
+#include "registry.h"
+#include "bus.h"
+#include "control.h"
+#include "events.h"
+#include "shm.h"
 #include "utils.h"
 #include "glib-object.h"
 #include "mediabox.h"
@@ -21,6 +26,7 @@
 #include <X11/Xatom.h>
 #include <X11/extensions/Xinerama.h>
 #include <signal.h>
+#include <glib-unix.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <cairo/cairo.h>
@@ -28,7 +34,6 @@
 #include <pango/pangocairo.h>
 #include "mediabox.h"
 
-#define MPRIS_PREFIX "org.mpris.MediaPlayer2."
 #define SOCKET_PATH "/tmp/awfulmc.sock"
 
 
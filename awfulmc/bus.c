@@ -0,0 +1,490 @@
+#include "bus.h"
+#include <glib-unix.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DISCOVERY_TIMEOUT_MS 2000
+#define FETCH_TIMEOUT_MS 2000
+
+static PlayerDelta *player_delta_new(PlayerDeltaKind kind, Player *player, PlayerChanges changes) {
+    PlayerDelta *delta = calloc(1, sizeof(PlayerDelta));
+    delta->kind = kind;
+    delta->instance = g_strdup(player->instance);
+    delta->changes = changes;
+    delta->properties.metadata = &delta->metadata;
+    if (kind == PLAYER_DELTA_ADDED || kind == PLAYER_DELTA_OWNER)
+        delta->unique = g_strdup(player->unique);
+    if (kind == PLAYER_DELTA_ADDED || kind == PLAYER_DELTA_CHANGED)
+        properties_copy(&delta->properties, player->player_properties);
+    return delta;
+}
+
+void player_delta_free(PlayerDelta *delta) {
+    properties_clear(&delta->properties);
+    g_free(delta->instance);
+    g_free(delta->unique);
+    free(delta);
+}
+
+// Moves as much of the backlog into the ring as fits. If it fills up again, the UI thread signals space_fd
+// once it has drained some, so nothing here polls while it is behind.
+static void flush_backlog(BusWorker *bus) {
+    for (;;) {
+        while (!g_queue_is_empty(&bus->backlog) && spsc_ring_push(bus->ring, g_queue_peek_head(&bus->backlog)))
+            g_queue_pop_head(&bus->backlog);
+        if (g_queue_is_empty(&bus->backlog) || spsc_ring_wait_space(bus->ring))
+            return;
+    }
+}
+
+static gboolean ring_space_callback(gint fd, GIOCondition condition, gpointer user_data) {
+    BusWorker *bus = user_data;
+    spsc_ring_ack_space(bus->ring);
+    flush_backlog(bus);
+    return G_SOURCE_CONTINUE;
+}
+
+// Deltas are never dropped, a UI thread that falls behind only makes them queue up here
+static void bus_emit(BusWorker *bus, PlayerDeltaKind kind, Player *player, PlayerChanges changes) {
+    PlayerDelta *delta = player_delta_new(kind, player, changes);
+    if (g_queue_is_empty(&bus->backlog) && spsc_ring_push(bus->ring, delta))
+        return;
+
+    g_queue_push_tail(&bus->backlog, delta);
+    if (g_queue_get_length(&bus->backlog) == 1) {
+        g_debug("delta ring full, deltas wait for the UI thread");
+        flush_backlog(bus);
+    }
+}
+
+static void player_signal_callback(GDBusConnection *con, const gchar *sender_name, const gchar *object_path, const gchar *interface_name, const gchar *signal_name, GVariant *parameters, gpointer user_data);
+
+// Called after the player is indexed under its unique name. Signals are matched per sender, so the first
+// player of a connection subscribes for every name it owns.
+static void player_subscribe_signals(BusWorker *bus, Player *player) {
+    UniqueEntry *entry = player_registry_unique_entry(bus->players, player->unique);
+    if (entry == NULL || entry->properties_subscription != 0)
+        return;
+
+    // Let the bus daemon drop everything this sender emits except its own MPRIS property changes
+    entry->properties_subscription = g_dbus_connection_signal_subscribe(
+        bus->con,
+        entry->unique,
+        "org.freedesktop.DBus.Properties",
+        "PropertiesChanged",
+        "/org/mpris/MediaPlayer2",
+        "org.mpris.MediaPlayer2.Player",
+        G_DBUS_SIGNAL_FLAGS_NONE,
+        player_signal_callback,
+        bus,
+        NULL);
+    // Position is never part of PropertiesChanged, jumps in it are only announced through Seeked
+    entry->seeked_subscription = g_dbus_connection_signal_subscribe(
+        bus->con,
+        entry->unique,
+        "org.mpris.MediaPlayer2.Player",
+        "Seeked",
+        "/org/mpris/MediaPlayer2",
+        NULL,
+        G_DBUS_SIGNAL_FLAGS_NONE,
+        player_signal_callback,
+        bus,
+        NULL);
+}
+
+static void unique_unsubscribe_signals(BusWorker *bus, UniqueEntry *entry) {
+    if (entry->properties_subscription != 0) {
+        g_dbus_connection_signal_unsubscribe(bus->con, entry->properties_subscription);
+        entry->properties_subscription = 0;
+    }
+    if (entry->seeked_subscription != 0) {
+        g_dbus_connection_signal_unsubscribe(bus->con, entry->seeked_subscription);
+        entry->seeked_subscription = 0;
+    }
+}
+
+// Called before the player leaves its unique name, the last one of a connection takes the matches along
+static void player_unsubscribe_signals(BusWorker *bus, Player *player) {
+    UniqueEntry *entry = player_registry_unique_entry(bus->players, player->unique);
+    if (entry != NULL && g_queue_get_length(&entry->players) == 1)
+        unique_unsubscribe_signals(bus, entry);
+}
+
+static void bus_add_player(BusWorker *bus, Player *player) {
+    player_registry_add(bus->players, player);
+    player_subscribe_signals(bus, player);
+}
+
+static void bus_remove_player(BusWorker *bus, Player *player) {
+    if (player->state == PLAYER_STATE_LIVE)
+        bus_emit(bus, PLAYER_DELTA_REMOVED, player, PLAYER_CHANGED_NONE);
+    player_unsubscribe_signals(bus, player);
+    player_registry_remove(bus->players, player);
+    player_free(player);
+}
+
+static void bus_set_player_owner(BusWorker *bus, Player *player, const char *unique) {
+    player_unsubscribe_signals(bus, player);
+    player_registry_set_unique(bus->players, player, unique);
+    player_subscribe_signals(bus, player);
+    if (player->state == PLAYER_STATE_LIVE)
+        bus_emit(bus, PLAYER_DELTA_OWNER, player, PLAYER_CHANGED_NONE);
+}
+
+static void print_players(BusWorker *bus) {
+    for (GList *l = bus->players->live.head; l != NULL; l = l->next) {
+        Player *player = l->data;
+        print_player(player);
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+static void discovery_done(BusWorker *bus) {
+    bus->discovery_outstanding--;
+    if (bus->discovery_outstanding == 0) {
+        g_info("Found %u players on the bus.", player_registry_live_count(bus->players));
+        print_players(bus);
+    }
+}
+
+typedef struct {
+    BusWorker *bus;
+    Player *player;
+    bool discovery;
+} PropertyFetch;
+
+static void fetch_properties_callback(GObject *source, GAsyncResult *res, gpointer user_data) {
+    PropertyFetch *fetch = user_data;
+    BusWorker *bus = fetch->bus;
+    Player *player = fetch->player;
+    bool discovery = fetch->discovery;
+    GError *err = NULL;
+    free(fetch);
+
+    GVariant *reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &err);
+    if (err != NULL) {
+        // A cancelled fetch means the player was freed while we were waiting on it
+        if (!g_error_matches(err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            if (player->state == PLAYER_STATE_LIVE) {
+                g_warning("Could not refresh properties for player %s: %s", player->name, err->message);
+            } else {
+                g_warning("Discarding player %s because we could not get the properties: %s", player->name, err->message);
+                bus_remove_player(bus, player);
+            }
+        }
+        g_error_free(err);
+        if (discovery)
+            discovery_done(bus);
+        return;
+    }
+
+    // Any PropertiesChanged that arrived while this call was in flight has already been merged into the
+    // player. The reply was sent after those signals, so applying it last leaves the newest values in place.
+    GVariant *properties = g_variant_get_child_value(reply, 0);
+    PlayerChanges changes = update_player_properties(player, properties);
+    g_variant_unref(properties);
+    g_variant_unref(reply);
+
+    if (player->state != PLAYER_STATE_LIVE) {
+        g_debug("player is live: unique=%s, instance=%s", player->unique, player->instance);
+        player->state = PLAYER_STATE_LIVE;
+        player_registry_set_live(bus->players, player);
+        // Deltas merged while fetching were never sent, the UI gets the whole state at once
+        bus_emit(bus, PLAYER_DELTA_ADDED, player, PLAYER_CHANGED_ALL);
+    } else if (changes != PLAYER_CHANGED_NONE) {
+        bus_emit(bus, PLAYER_DELTA_CHANGED, player, changes);
+    }
+
+    if (discovery)
+        discovery_done(bus);
+}
+
+static void fetch_player_properties(BusWorker *bus, Player *player, bool discovery) {
+    PropertyFetch *fetch = calloc(1, sizeof(PropertyFetch));
+    fetch->bus = bus;
+    fetch->player = player;
+    fetch->discovery = discovery;
+
+    if (player->state == PLAYER_STATE_FETCHING) {
+        // Owner changed mid-fetch, the reply in flight belongs to the old owner
+        g_cancellable_cancel(player->cancellable);
+        g_object_unref(player->cancellable);
+        player->cancellable = g_cancellable_new();
+    } else if (player->state == PLAYER_STATE_PENDING) {
+        player->state = PLAYER_STATE_FETCHING;
+    }
+
+    g_dbus_connection_call(
+        bus->con,
+        player->unique,
+        "/org/mpris/MediaPlayer2",
+        "org.freedesktop.DBus.Properties",
+        "GetAll",
+        g_variant_new("(s)", "org.mpris.MediaPlayer2.Player"),
+        G_VARIANT_TYPE("(a{sv})"),
+        G_DBUS_CALL_FLAGS_NO_AUTO_START,
+        FETCH_TIMEOUT_MS,
+        player->cancellable,
+        fetch_properties_callback,
+        fetch
+    );
+}
+
+typedef struct {
+    BusWorker *bus;
+    gchar *name;
+} DiscoveryRequest;
+
+static void discovery_owner_callback(GObject *source, GAsyncResult *res, gpointer user_data) {
+    DiscoveryRequest *req = user_data;
+    BusWorker *bus = req->bus;
+    GError *err = NULL;
+
+    GVariant *reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &err);
+    if (err != NULL) {
+        g_warning("Discarding player %s because we could not get owner: %s", req->name, err->message);
+        g_error_free(err);
+        discovery_done(bus);
+        g_free(req->name);
+        free(req);
+        return;
+    }
+
+    const gchar *owner;
+    g_variant_get(reply, "(&s)", &owner);
+    g_debug("Found owner for %s: %s", req->name, owner);
+
+    const gchar *instance = req->name + strlen(MPRIS_PREFIX);
+    if (player_registry_find_instance(bus->players, instance) != NULL) {
+        // NameOwnerChanged got to this player before discovery did
+        g_debug("player %s already managed, skipping discovery", instance);
+        discovery_done(bus);
+    } else {
+        Player *player = player_new(owner, instance);
+        bus_add_player(bus, player);
+        fetch_player_properties(bus, player, true);
+    }
+
+    g_variant_unref(reply);
+    g_free(req->name);
+    free(req);
+}
+
+static void discovery_list_names_callback(GObject *source, GAsyncResult *res, gpointer user_data) {
+    BusWorker *bus = user_data;
+    GError *err = NULL;
+
+    GVariant *reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &err);
+    if (err != NULL) {
+        g_printerr("Could not list currently active players: %s", err->message);
+        g_error_free(err);
+        g_main_loop_quit(bus->ui_loop);
+        return;
+    }
+
+    GVariantIter *names;
+    const gchar *name;
+    g_variant_get(reply, "(as)", &names);
+
+    // Every owner lookup goes out now; each one chains into its own GetAll as soon as it is answered.
+    // The extra reference keeps the count from hitting zero before the whole list has been dispatched.
+    bus->discovery_outstanding++;
+    while (g_variant_iter_next(names, "&s", &name)) {
+        if (!g_str_has_prefix(name, MPRIS_PREFIX))
+            continue;
+
+        DiscoveryRequest *req = calloc(1, sizeof(DiscoveryRequest));
+        req->bus = bus;
+        req->name = g_strdup(name);
+        bus->discovery_outstanding++;
+
+        g_dbus_connection_call(
+            bus->con,
+            "org.freedesktop.DBus",
+            "/org/freedesktop/DBus",
+            "org.freedesktop.DBus",
+            "GetNameOwner",
+            g_variant_new("(s)", name),
+            G_VARIANT_TYPE("(s)"),
+            G_DBUS_CALL_FLAGS_NO_AUTO_START,
+            DISCOVERY_TIMEOUT_MS,
+            NULL,
+            discovery_owner_callback,
+            req
+        );
+    }
+    g_variant_iter_free(names);
+    g_variant_unref(reply);
+    discovery_done(bus);
+}
+
+static void discover_players(BusWorker *bus) {
+    g_info("Getting list of player names from D-Bus");
+    g_dbus_connection_call(
+        bus->con,
+        "org.freedesktop.DBus",
+        "/org/freedesktop/DBus",
+        "org.freedesktop.DBus",
+        "ListNames",
+        NULL,
+        G_VARIANT_TYPE("(as)"),
+        G_DBUS_CALL_FLAGS_NONE,
+        DISCOVERY_TIMEOUT_MS,
+        NULL,
+        discovery_list_names_callback,
+        bus
+    );
+}
+
+static void player_signal_callback(GDBusConnection *con, const gchar *sender_name, const gchar *object_path, const gchar *interface_name, const gchar *signal_name, GVariant *parameters, gpointer user_data) {
+    BusWorker *bus = user_data;
+    UniqueEntry *entry = player_registry_unique_entry(bus->players, sender_name);
+    if (entry == NULL)
+        return;
+
+    gchar *p = g_variant_print(parameters, true);
+    g_debug("got player signal: sender=%s, object_path=%s, interface_name=%s, signal_name=%s, parameters=%s", sender_name, object_path, interface_name, signal_name, p);
+    g_free(p);
+
+    GVariant *properties = NULL;
+    gint64 position = 0;
+    if (g_strcmp0(signal_name, "PropertiesChanged") == 0) {
+        properties = g_variant_get_child_value(parameters, 1);
+    } else if (g_strcmp0(signal_name, "Seeked") == 0 && g_variant_is_of_type(parameters, G_VARIANT_TYPE("(x)"))) {
+        g_variant_get(parameters, "(x)", &position);
+    } else {
+        return;
+    }
+
+    // The signal cannot tell which of the sender's names it is about, every one of them gets it
+    for (GList *l = entry->players.head; l != NULL; l = l->next) {
+        Player *player = l->data;
+        PlayerChanges changes = properties != NULL ? update_player_properties(player, properties) : player_seeked(player, position);
+
+        // Players still fetching their initial state take the delta but stay hidden until GetAll lands
+        if (changes != PLAYER_CHANGED_NONE && player->state == PLAYER_STATE_LIVE) {
+            g_info("Player %s Properties Changed (0x%x)", player->name, changes);
+            bus_emit(bus, PLAYER_DELTA_CHANGED, player, changes);
+        }
+    }
+    if (properties != NULL)
+        g_variant_unref(properties);
+}
+
+static void name_owner_changed_callback(GDBusConnection *con, const gchar *sender_name, const gchar *object_path, const gchar *interface_name, const gchar *signal_name, GVariant *parameters, gpointer user_data) {
+    BusWorker *bus = user_data;
+    const gchar *name;
+    const gchar *new_owner;
+    g_variant_get(parameters, "(&s&s&s)", &name, NULL, &new_owner);
+
+    if (!g_str_has_prefix(name, MPRIS_PREFIX))
+        return;
+
+    g_debug("got name owner changed signal: name='%s', 'owner'%s'", name, new_owner);
+
+    const gchar *instance = name + strlen(MPRIS_PREFIX);
+    Player *player = player_registry_find_instance(bus->players, instance);
+    if (strlen(new_owner) > 0) {
+        g_debug("player name appeared: unique=%s, name=%s", new_owner, name);
+        if (player != NULL) {
+            g_debug("player already managed, updating owner and refreshing properties");
+            bus_set_player_owner(bus, player, new_owner);
+        } else {
+            g_debug("getting properties for new player");
+            player = player_new(new_owner, instance);
+            bus_add_player(bus, player);
+        }
+        fetch_player_properties(bus, player, false);
+    } else if (player != NULL) {
+        g_debug("removing name from players: unique=%s, name=%s", player->unique, player->name);
+        bus_remove_player(bus, player);
+    } else {
+        g_debug("name '%s' not found in queue", instance);
+    }
+}
+
+static gpointer bus_thread(gpointer user_data) {
+    BusWorker *bus = user_data;
+    // Signal subscriptions and async calls dispatch to the context that is thread default when they are made
+    g_main_context_push_thread_default(bus->context);
+
+    // arg0namespace keeps NameOwnerChanged for every other name on the bus from ever reaching us.
+    // PropertiesChanged is subscribed per connection, scoped to its unique name, in bus_add_player().
+    bus->name_owner_subscription = g_dbus_connection_signal_subscribe(
+        bus->con,
+        "org.freedesktop.DBus",
+        "org.freedesktop.DBus",
+        "NameOwnerChanged",
+        "/org/freedesktop/DBus",
+        MPRIS_NAMESPACE,
+        G_DBUS_SIGNAL_FLAGS_MATCH_ARG0_NAMESPACE,
+        name_owner_changed_callback,
+        bus,
+        NULL);
+    discover_players(bus);
+
+    g_main_loop_run(bus->loop);
+
+    g_dbus_connection_signal_unsubscribe(bus->con, bus->name_owner_subscription);
+    GHashTableIter iter;
+    gpointer entry;
+    g_hash_table_iter_init(&iter, bus->players->by_unique);
+    while (g_hash_table_iter_next(&iter, NULL, &entry)) {
+        unique_unsubscribe_signals(bus, entry);
+    }
+    g_main_context_pop_thread_default(bus->context);
+    return NULL;
+}
+
+BusWorker *bus_worker_new(GDBusConnection *con, GMainLoop *ui_loop) {
+    SpscRing *ring = spsc_ring_new();
+    if (ring == NULL)
+        return NULL;
+
+    BusWorker *bus = calloc(1, sizeof(BusWorker));
+    bus->ring = ring;
+    bus->con = g_object_ref(con);
+    bus->ui_loop = ui_loop;
+    bus->players = player_registry_new();
+    bus->context = g_main_context_new();
+    bus->loop = g_main_loop_new(bus->context, false);
+    g_queue_init(&bus->backlog);
+    // Stays attached, it only fires when the UI thread made room for a waiting backlog
+    bus->space_watch = g_unix_fd_source_new(ring->space_fd, G_IO_IN);
+    g_source_set_callback(bus->space_watch, G_SOURCE_FUNC(ring_space_callback), bus, NULL);
+    g_source_attach(bus->space_watch, bus->context);
+    bus->thread = g_thread_new("awfulmc-bus", bus_thread, bus);
+    return bus;
+}
+
+static gboolean quit_bus_loop(gpointer user_data) {
+    BusWorker *bus = user_data;
+    g_main_loop_quit(bus->loop);
+    return G_SOURCE_REMOVE;
+}
+
+void bus_worker_free(BusWorker *bus) {
+    if (bus == NULL)
+        return;
+
+    // Quitting from inside the loop, a g_main_loop_quit() from here could land before it even started
+    g_main_context_invoke(bus->context, quit_bus_loop, bus);
+    g_thread_join(bus->thread);
+
+    g_source_destroy(bus->space_watch);
+    g_source_unref(bus->space_watch);
+    g_queue_clear_full(&bus->backlog, (GDestroyNotify)player_delta_free);
+    PlayerDelta *delta;
+    while ((delta = spsc_ring_pop(bus->ring)) != NULL) {
+        player_delta_free(delta);
+    }
+    spsc_ring_free(bus->ring);
+
+    player_registry_free(bus->players);
+    g_main_loop_unref(bus->loop);
+    g_main_context_unref(bus->context);
+    g_object_unref(bus->con);
+    free(bus);
+}
@@ -0,0 +1,54 @@
+#ifndef __BUS_H__
+#define __BUS_H__
+
+#include "registry.h"
+#include "spsc.h"
+#include <gio/gio.h>
+
+#define MPRIS_NAMESPACE "org.mpris.MediaPlayer2"
+#define MPRIS_PREFIX MPRIS_NAMESPACE "."
+
+typedef enum {
+    // The player answered its first GetAll, unique and the whole state are set
+    PLAYER_DELTA_ADDED,
+    // changes says which parts of the state are new
+    PLAYER_DELTA_CHANGED,
+    // A live player moved to another connection, only unique is set
+    PLAYER_DELTA_OWNER,
+    PLAYER_DELTA_REMOVED,
+} PlayerDeltaKind;
+
+// A copy of one player's state as of a change, passed from the bus thread to the UI thread and never
+// modified after. Strings are shared GRefStrings, so making one costs a few reference counts.
+typedef struct {
+    PlayerDeltaKind kind;
+    char *instance;
+    char *unique;
+    PlayerChanges changes;
+    PlayerProperties properties;
+    PlayerMetadata metadata;
+} PlayerDelta;
+
+// The D-Bus side of awfulmc: discovery, NameOwnerChanged, the per player signals and GetAll calls, all
+// dispatched from its own thread and GMainContext with its own registry. The only thing shared with the
+// UI thread is the ring, live players come out of it as PlayerDeltas.
+typedef struct {
+    GThread *thread;
+    GMainContext *context;
+    GMainLoop *loop;
+    GDBusConnection *con;
+    PlayerRegistry *players;
+    guint discovery_outstanding;
+    guint name_owner_subscription;
+    SpscRing *ring;
+    // Deltas the ring had no room for, pushed ahead of anything newer when space_watch fires
+    GQueue backlog;
+    GSource *space_watch;
+    // Quit if the bus side cannot start
+    GMainLoop *ui_loop;
+} BusWorker;
+
+BusWorker *bus_worker_new(GDBusConnection *con, GMainLoop *ui_loop);
+void bus_worker_free(BusWorker *bus);
+void player_delta_free(PlayerDelta *delta);
+#endif
@@ -0,0 +1,324 @@
+#define _GNU_SOURCE
+#include "control.h"
+#include <glib-unix.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+typedef struct {
+    ControlServer *server;
+    ControlClient *client;
+} ControlWatch;
+
+static int create_unix_socket(const char *path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("socket creation failed");
+        return -1;
+    }
+
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        perror("socket bind failed");
+        close(fd);
+        return -1;
+    }
+
+    // Key repeat can connect faster than we get to accept, do not let the kernel refuse those
+    if (listen(fd, CONTROL_BACKLOG) == -1) {
+        perror("socket listen failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static gboolean control_client_out_callback(gint fd, GIOCondition condition, gpointer user_data);
+
+static guint control_client_watch(ControlServer *server, ControlClient *client, GIOCondition condition, GUnixFDSourceFunc func) {
+    ControlWatch *watch = calloc(1, sizeof(ControlWatch));
+    watch->server = server;
+    watch->client = client;
+    return g_unix_fd_add_full(G_PRIORITY_DEFAULT, client->fd, condition, func, watch, free);
+}
+
+static void control_client_free(ControlServer *server, ControlClient *client) {
+    g_debug("control client %d disconnected", client->fd);
+    server->clients = g_list_remove(server->clients, client);
+    if (client->subscribed)
+        server->subscribers--;
+    if (client->watch != 0)
+        g_source_remove(client->watch);
+    if (client->out_watch != 0)
+        g_source_remove(client->out_watch);
+    close(client->fd);
+    g_string_free(client->in, true);
+    g_string_free(client->out, true);
+    free(client);
+}
+
+// Writes as much of the pending output as the socket takes without blocking
+static void control_client_flush(ControlClient *client) {
+    while (client->out->len > 0) {
+        ssize_t written = send(client->fd, client->out->str, client->out->len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (written == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            // The input watch sees the hangup and frees the client, until then everything is discarded
+            g_debug("control client %d write failed: %s", client->fd, strerror(errno));
+            client->closed = true;
+            g_string_truncate(client->out, 0);
+            return;
+        }
+        g_string_erase(client->out, 0, written);
+    }
+}
+
+// Returns false if the data does not fit in the output buffer, nothing is queued in that case
+static bool control_client_queue(ControlClient *client, const char *data, gsize len) {
+    if (client->closed || client->draining)
+        return true;
+    if (client->out->len + len > CONTROL_OUT_MAX)
+        return false;
+
+    bool idle = client->out->len == 0;
+    g_string_append_len(client->out, data, len);
+    if (idle)
+        control_client_flush(client);
+    return true;
+}
+
+// Starts or stops waiting for the socket to become writable depending on what is left to send
+static void control_client_update_out_watch(ControlServer *server, ControlClient *client) {
+    if (client->out->len > 0 && client->out_watch == 0) {
+        client->out_watch = control_client_watch(server, client, G_IO_OUT, control_client_out_callback);
+    } else if (client->out->len == 0 && client->out_watch != 0) {
+        g_source_remove(client->out_watch);
+        client->out_watch = 0;
+    }
+}
+
+static void control_client_queue_dropped(ControlClient *client) {
+    if (client->dropped == 0)
+        return;
+
+    char notice[32];
+    int len = snprintf(notice, sizeof(notice), "DROPPED\t%u\n", client->dropped);
+    if (control_client_queue(client, notice, len))
+        client->dropped = 0;
+}
+
+void control_client_send_event(ControlClient *client, const char *event, gsize len) {
+    control_client_queue_dropped(client);
+    if (client->dropped > 0 || !control_client_queue(client, event, len))
+        client->dropped++;
+}
+
+void control_server_publish(ControlServer *server, const char *event, gsize len) {
+    for (GList *l = server->clients; l != NULL; l = l->next) {
+        ControlClient *client = l->data;
+        if (!client->subscribed)
+            continue;
+        control_client_send_event(client, event, len);
+        control_client_update_out_watch(server, client);
+    }
+}
+
+static bool control_client_reply(ControlClient *client, const char *error) {
+    if (error == NULL)
+        return control_client_queue(client, "OK\n", 3);
+
+    char reply[CONTROL_LINE_MAX];
+    int len = snprintf(reply, sizeof(reply), "ERR %s\n", error);
+    return control_client_queue(client, reply, MIN((size_t)len, sizeof(reply) - 1));
+}
+
+static const char *control_client_command(ControlServer *server, ControlClient *client, const char *line, bool *snapshot) {
+    if (strcmp(line, "SUBSCRIBE") == 0) {
+        if (!client->subscribed)
+            server->subscribers++;
+        client->subscribed = true;
+        client->dropped = 0;
+        *snapshot = true;
+        return NULL;
+    } else if (strcmp(line, "UNSUBSCRIBE") == 0) {
+        if (client->subscribed)
+            server->subscribers--;
+        client->subscribed = false;
+        return NULL;
+    }
+    return server->command(line, server->user_data);
+}
+
+// Runs every complete line in the input buffer, a trailing partial line is kept for the next read
+static bool control_client_dispatch(ControlServer *server, ControlClient *client) {
+    gsize start = 0;
+    char *newline;
+    while ((newline = memchr(client->in->str + start, '\n', client->in->len - start)) != NULL) {
+        *newline = '\0';
+        char *line = client->in->str + start;
+        start = newline - client->in->str + 1;
+
+        gsize len = strlen(line);
+        if (len > 0 && line[len - 1] == '\r')
+            line[len - 1] = '\0';
+        if (line[0] == '\0')
+            continue;
+
+        g_debug("control client %d: '%s'", client->fd, line);
+        bool snapshot = false;
+        // A client that does not even read its replies has stopped reading altogether
+        if (!control_client_reply(client, control_client_command(server, client, line, &snapshot)))
+            return false;
+        if (snapshot && server->snapshot != NULL)
+            server->snapshot(client, server->user_data);
+    }
+    g_string_erase(client->in, 0, start);
+
+    if (client->in->len > CONTROL_LINE_MAX) {
+        control_client_reply(client, "line too long");
+        client->draining = true;
+    }
+    return true;
+}
+
+// Stops reading from the client and frees it once its replies are out
+static void control_client_drain(ControlServer *server, ControlClient *client) {
+    client->draining = true;
+    if (client->closed || client->out->len == 0) {
+        control_client_free(server, client);
+        return;
+    }
+    control_client_update_out_watch(server, client);
+}
+
+static gboolean control_client_callback(gint fd, GIOCondition condition, gpointer user_data) {
+    ControlWatch *watch = user_data;
+    ControlServer *server = watch->server;
+    ControlClient *client = watch->client;
+
+    // Drain everything the client has sent before answering, so a burst costs one wakeup. Lines run as
+    // soon as they are complete, so the buffer never holds more than one unfinished line and one read,
+    // however fast the client writes.
+    char buffer[CONTROL_READ_SIZE];
+    bool hangup = (condition & (G_IO_HUP | G_IO_ERR | G_IO_NVAL)) != 0;
+    bool keep = true;
+    server->received = g_get_monotonic_time();
+    for (;;) {
+        ssize_t bytes_read = recv(fd, buffer, sizeof(buffer), 0);
+        if (bytes_read > 0) {
+            g_string_append_len(client->in, buffer, bytes_read);
+            keep = control_client_dispatch(server, client);
+            if (!keep || client->closed || client->draining)
+                break;
+            continue;
+        }
+        if (bytes_read == -1 && errno == EINTR)
+            continue;
+        if (bytes_read == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            hangup = true;
+        break;
+    }
+    // `printf TOGGLE | socat ...` sends its only command without a newline
+    if (keep && hangup && !client->closed && !client->draining && client->in->len > 0) {
+        g_string_append_c(client->in, '\n');
+        keep = control_client_dispatch(server, client);
+    }
+    server->received = 0;
+
+    if (keep && !hangup && !client->closed && !client->draining) {
+        control_client_update_out_watch(server, client);
+        return true;
+    }
+    // Returning false removes the source, make sure control_client_free() does not remove it again
+    client->watch = 0;
+    // Its output is full, see control_client_dispatch()
+    if (!keep)
+        control_client_free(server, client);
+    else
+        control_client_drain(server, client);
+    return false;
+}
+
+static gboolean control_client_out_callback(gint fd, GIOCondition condition, gpointer user_data) {
+    ControlWatch *watch = user_data;
+    ControlServer *server = watch->server;
+    ControlClient *client = watch->client;
+
+    control_client_flush(client);
+    if (client->out->len == 0)
+        control_client_queue_dropped(client);
+    if (client->closed || (client->draining && client->out->len == 0)) {
+        client->out_watch = 0;
+        control_client_free(server, client);
+        return false;
+    }
+    if (client->out->len == 0) {
+        client->out_watch = 0;
+        return false;
+    }
+    return true;
+}
+
+static gboolean control_accept_callback(gint fd, GIOCondition condition, gpointer user_data) {
+    ControlServer *server = user_data;
+
+    for (;;) {
+        int client_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                perror("Could not accept client connection");
+            return true;
+        }
+
+        ControlClient *client = calloc(1, sizeof(ControlClient));
+        client->fd = client_fd;
+        client->in = g_string_sized_new(CONTROL_LINE_MAX);
+        client->out = g_string_sized_new(CONTROL_LINE_MAX);
+        client->watch = control_client_watch(server, client, G_IO_IN | G_IO_HUP | G_IO_ERR, control_client_callback);
+        server->clients = g_list_prepend(server->clients, client);
+        g_debug("control client %d connected", client_fd);
+    }
+}
+
+ControlServer *control_server_new(const char *path, ControlCommandFunc command, ControlSnapshotFunc snapshot, gpointer user_data) {
+    int fd = create_unix_socket(path);
+    if (fd == -1)
+        return NULL;
+
+    ControlServer *server = calloc(1, sizeof(ControlServer));
+    server->fd = fd;
+    server->path = g_strdup(path);
+    server->command = command;
+    server->snapshot = snapshot;
+    server->user_data = user_data;
+    server->watch = g_unix_fd_add(fd, G_IO_IN, control_accept_callback, server);
+    return server;
+}
+
+void control_server_free(ControlServer *server) {
+    if (server == NULL)
+        return;
+
+    while (server->clients != NULL)
+        control_client_free(server, server->clients->data);
+    g_source_remove(server->watch);
+    close(server->fd);
+    unlink(server->path);
+    g_free(server->path);
+    free(server);
+}
@@ -0,0 +1,54 @@
+#ifndef __CONTROL_H__
+#define __CONTROL_H__
+
+#include "glib.h"
+#include <stdbool.h>
+
+#define CONTROL_BACKLOG SOMAXCONN
+#define CONTROL_READ_SIZE 4096
+#define CONTROL_LINE_MAX 256
+#define CONTROL_OUT_MAX (64 * 1024)
+
+typedef struct {
+    int fd;
+    guint watch;
+    guint out_watch;
+    GString *in;
+    // Bytes the socket did not take yet, never allowed past CONTROL_OUT_MAX
+    GString *out;
+    bool subscribed;
+    // Writing failed, everything queued is discarded until the input watch frees the client
+    bool closed;
+    // Nothing more is read or queued, the client is freed once out is sent
+    bool draining;
+    guint dropped;
+} ControlClient;
+
+// Runs one command line (without its newline). Returns NULL on success or a short reason that is sent back
+// to the client as "ERR <reason>".
+typedef const char *(*ControlCommandFunc)(const char *line, gpointer user_data);
+// Queues the full current state on a client that just subscribed
+typedef void (*ControlSnapshotFunc)(ControlClient *client, gpointer user_data);
+
+// Clients stay connected and may pipeline any number of newline terminated commands, each one is answered
+// with a single "OK" or "ERR <reason>" line in order. After SUBSCRIBE a client also receives every published
+// event. A subscriber that stops reading loses events instead of stalling the main loop, it is told how many
+// with a "DROPPED\t<count>" line once it catches up and can SUBSCRIBE again for a fresh snapshot.
+typedef struct {
+    int fd;
+    char *path;
+    guint watch;
+    GList *clients;
+    guint subscribers;
+    // Monotonic time the lines being dispatched were read off the socket, 0 outside of dispatch
+    gint64 received;
+    ControlCommandFunc command;
+    ControlSnapshotFunc snapshot;
+    gpointer user_data;
+} ControlServer;
+
+ControlServer *control_server_new(const char *path, ControlCommandFunc command, ControlSnapshotFunc snapshot, gpointer user_data);
+void control_server_free(ControlServer *server);
+void control_server_publish(ControlServer *server, const char *event, gsize len);
+void control_client_send_event(ControlClient *client, const char *event, gsize len);
+#endif
@@ -0,0 +1,116 @@
+#include "events.h"
+#include <stddef.h>
+
+typedef enum {
+    FIELD_FLAG,
+    FIELD_STRING,
+    FIELD_PLAYBACK_STATUS,
+    FIELD_LOOP_STATUS,
+    FIELD_RATE,
+    FIELD_POSITION,
+    FIELD_LENGTH,
+} FieldType;
+
+typedef struct {
+    PlayerChanges change;
+    const char *key;
+    FieldType type;
+    size_t offset;
+} EventField;
+
+// Offsets of string fields are into PlayerMetadata, flag fields hold their PlayerFlag
+static const EventField event_fields[] = {
+    { PLAYER_CHANGED_PLAYBACK_STATUS, "status",      FIELD_PLAYBACK_STATUS, 0 },
+    { PLAYER_CHANGED_LOOP_STATUS,     "loop",        FIELD_LOOP_STATUS,     0 },
+    { PLAYER_CHANGED_SHUFFLE,         "shuffle",     FIELD_FLAG,            PLAYER_FLAG_SHUFFLE },
+    { PLAYER_CHANGED_TITLE,           "title",       FIELD_STRING,          offsetof(PlayerMetadata, title) },
+    { PLAYER_CHANGED_ARTIST,          "artist",      FIELD_STRING,          offsetof(PlayerMetadata, artist) },
+    { PLAYER_CHANGED_ALBUM,           "album",       FIELD_STRING,          offsetof(PlayerMetadata, album) },
+    { PLAYER_CHANGED_ART_URL,         "art",         FIELD_STRING,          offsetof(PlayerMetadata, art_url) },
+    { PLAYER_CHANGED_CAN_GO_NEXT,     "can_next",    FIELD_FLAG,            PLAYER_FLAG_CAN_GO_NEXT },
+    { PLAYER_CHANGED_CAN_GO_PREVIOUS, "can_prev",    FIELD_FLAG,            PLAYER_FLAG_CAN_GO_PREVIOUS },
+    { PLAYER_CHANGED_CAN_PLAY,        "can_play",    FIELD_FLAG,            PLAYER_FLAG_CAN_PLAY },
+    { PLAYER_CHANGED_CAN_PAUSE,       "can_pause",   FIELD_FLAG,            PLAYER_FLAG_CAN_PAUSE },
+    { PLAYER_CHANGED_CAN_CONTROL,     "can_control", FIELD_FLAG,            PLAYER_FLAG_CAN_CONTROL },
+    { PLAYER_CHANGED_RATE,            "rate",        FIELD_RATE,            0 },
+    { PLAYER_CHANGED_POSITION,        "position",    FIELD_POSITION,        0 },
+    { PLAYER_CHANGED_LENGTH,          "length",      FIELD_LENGTH,          0 },
+};
+
+static void append_escaped(GString *out, const char *str) {
+    if (str == NULL)
+        return;
+
+    for (const char *c = str; *c != '\0'; c++) {
+        switch (*c) {
+        case '\\':
+            g_string_append(out, "\\\\");
+            break;
+        case '\t':
+            g_string_append(out, "\\t");
+            break;
+        case '\n':
+            g_string_append(out, "\\n");
+            break;
+        default:
+            g_string_append_c(out, *c);
+        }
+    }
+}
+
+void event_player_added(GString *out, Player *player) {
+    g_string_append(out, "ADDED\t");
+    append_escaped(out, player->instance);
+    g_string_append_c(out, '\t');
+    append_escaped(out, player->name);
+    g_string_append_c(out, '\n');
+}
+
+void event_player_removed(GString *out, Player *player) {
+    g_string_append(out, "REMOVED\t");
+    append_escaped(out, player->instance);
+    g_string_append_c(out, '\n');
+}
+
+void event_player_update(GString *out, Player *player, PlayerChanges changes) {
+    PlayerProperties *props = player->player_properties;
+    if (changes == PLAYER_CHANGED_NONE || props == NULL)
+        return;
+
+    g_string_append(out, "UPDATE\t");
+    append_escaped(out, player->instance);
+    for (size_t i = 0; i < G_N_ELEMENTS(event_fields); i++) {
+        const EventField *field = &event_fields[i];
+        if (!(changes & field->change))
+            continue;
+
+        g_string_append_c(out, '\t');
+        g_string_append(out, field->key);
+        g_string_append_c(out, '=');
+        switch (field->type) {
+        case FIELD_FLAG:
+            g_string_append_c(out, player_has_flag(props, field->offset) ? '1' : '0');
+            break;
+        case FIELD_STRING:
+            append_escaped(out, *(char **)((char *)props->metadata + field->offset));
+            break;
+        case FIELD_PLAYBACK_STATUS:
+            g_string_append(out, convert_from_playback_status(props->playback_status));
+            break;
+        case FIELD_LOOP_STATUS:
+            g_string_append(out, convert_from_loop_status(props->loop_status));
+            break;
+        case FIELD_RATE:
+            g_string_append_printf(out, "%g", props->rate);
+            break;
+        case FIELD_POSITION:
+            // Microseconds as of now, subscribers extrapolate from status and rate like we do
+            g_string_append_printf(out, "%" G_GINT64_FORMAT, player_position(props, g_get_monotonic_time()));
+            break;
+        case FIELD_LENGTH:
+            g_string_append_printf(out, "%" G_GINT64_FORMAT, props->metadata->length);
+            break;
+        }
+    }
+    g_string_append_c(out, '\n');
+}
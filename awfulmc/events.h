@@ -0,0 +1,15 @@
+#ifndef __EVENTS_H__
+#define __EVENTS_H__
+
+#include "glib.h"
+#include "player.h"
+
+// Subscriber events are single lines of tab separated fields:
+//   ADDED\t<instance>\t<name>
+//   REMOVED\t<instance>
+//   UPDATE\t<instance>\t<key>=<value>...   (only the fields that changed)
+// Values escape backslash, tab and newline as \\, \t and \n.
+void event_player_added(GString *out, Player *player);
+void event_player_removed(GString *out, Player *player);
+void event_player_update(GString *out, Player *player, PlayerChanges changes);
+#endif
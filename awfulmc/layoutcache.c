@@ -0,0 +1,66 @@
+#include "layoutcache.h"
+
+typedef struct {
+    char *text;
+    const PangoFontDescription *font;
+    PangoLayout *layout;
+    GList link;
+} LayoutCacheEntry;
+
+static guint entry_hash(gconstpointer key) {
+    const LayoutCacheEntry *entry = key;
+    return g_str_hash(entry->text) ^ g_direct_hash(entry->font);
+}
+
+static gboolean entry_equal(gconstpointer a, gconstpointer b) {
+    const LayoutCacheEntry *ea = a, *eb = b;
+    return ea->font == eb->font && strcmp(ea->text, eb->text) == 0;
+}
+
+static void entry_free(gpointer data) {
+    LayoutCacheEntry *entry = data;
+    g_object_unref(entry->layout);
+    g_free(entry->text);
+    free(entry);
+}
+
+LayoutCache *layout_cache_new(PangoContext *pango, guint capacity) {
+    LayoutCache *cache = calloc(1, sizeof(LayoutCache));
+    cache->pango = g_object_ref(pango);
+    cache->entries = g_hash_table_new_full(entry_hash, entry_equal, entry_free, NULL);
+    g_queue_init(&cache->lru);
+    cache->capacity = capacity;
+    return cache;
+}
+
+void layout_cache_free(LayoutCache *cache) {
+    g_hash_table_destroy(cache->entries);
+    g_object_unref(cache->pango);
+    free(cache);
+}
+
+PangoLayout *layout_cache_get(LayoutCache *cache, const char *text, const PangoFontDescription *font) {
+    LayoutCacheEntry find = { .text = (char *)text, .font = font };
+    LayoutCacheEntry *entry = g_hash_table_lookup(cache->entries, &find);
+    if (entry != NULL) {
+        g_queue_unlink(&cache->lru, &entry->link);
+        g_queue_push_head_link(&cache->lru, &entry->link);
+        return entry->layout;
+    }
+
+    if (cache->lru.length >= cache->capacity) {
+        GList *oldest = g_queue_pop_tail_link(&cache->lru);
+        g_hash_table_remove(cache->entries, oldest->data);
+    }
+
+    entry = calloc(1, sizeof(LayoutCacheEntry));
+    entry->text = g_strdup(text);
+    entry->font = font;
+    entry->layout = pango_layout_new(cache->pango);
+    pango_layout_set_font_description(entry->layout, font);
+    pango_layout_set_text(entry->layout, text, -1);
+    entry->link.data = entry;
+    g_queue_push_head_link(&cache->lru, &entry->link);
+    g_hash_table_add(cache->entries, entry);
+    return entry->layout;
+}
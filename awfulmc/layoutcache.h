@@ -0,0 +1,22 @@
+#ifndef __LAYOUTCACHE_H__
+#define __LAYOUTCACHE_H__
+
+#include "glib.h"
+#include <pango/pangocairo.h>
+
+#define LAYOUT_CACHE_SIZE 64
+
+// Shaped layouts keyed by (text, font). Every FontSize has exactly one long lived font description, so
+// the description pointer identifies the size. The least recently used layout is dropped once the
+// cache holds more than capacity entries.
+typedef struct {
+    PangoContext *pango;
+    GHashTable *entries;
+    GQueue lru;
+    guint capacity;
+} LayoutCache;
+
+LayoutCache *layout_cache_new(PangoContext *pango, guint capacity);
+void layout_cache_free(LayoutCache *cache);
+PangoLayout *layout_cache_get(LayoutCache *cache, const char *text, const PangoFontDescription *font);
+#endif
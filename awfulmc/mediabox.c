@@ -7,77 +7,49 @@
 #include <X11/X.h>
 #include <X11/Xlib.h>
 
-#define NO_WINDOW 0
-
-void create_window(MediaBoxContext* mbc) {
-    int x = (DisplayWidth(mbc->display, mbc->screen) - WIDTH) / 2;
-    int y = (DisplayHeight(mbc->display, mbc->screen) - HEIGHT) / 1.2;
-
-    XSetWindowAttributes attrs;
-    attrs.override_redirect = true;
-    attrs.background_pixel = WhitePixel(mbc->display, mbc->screen);
-    mbc->win = XCreateWindow(
-        mbc->display,
-        RootWindow(mbc->display, mbc->screen),
-        x,
-        y,
-        WIDTH,
-        HEIGHT,
-        1,
-        CopyFromParent,
-        CopyFromParent,
-        CopyFromParent,
-        CWOverrideRedirect | CWBackPixel,
-        &attrs
-    );
-
-    Atom wm_state = XInternAtom(mbc->display, "_NET_WM_STATE", false);
-    Atom wm_state_above = XInternAtom(mbc->display, "_NET_WM_STATE_ABOVE", false);
-    Atom wm_window_type = XInternAtom(mbc->display, "_NET_WM_WINDOW_TYPE", false);
-    Atom wm_window_type_dialog = XInternAtom(mbc->display, "_NET_WM_WINDOW_TYPE_DIALOG", false);
-    XChangeProperty(mbc->display, mbc->win, wm_window_type, XA_ATOM, 32,
-                    PropModeReplace, (unsigned char *)&wm_window_type_dialog, 1);
-    XChangeProperty(mbc->display, mbc->win, wm_state, XA_ATOM, 32,
-                    PropModeReplace, (unsigned char *)&wm_state_above, 1);
-
-    mbc->gc = XCreateGC(mbc->display, mbc->win, 0, NULL);
-    XSelectInput(mbc->display, mbc->win, ExposureMask | ButtonPressMask);
-
-    mbc->cairo_surface = cairo_xlib_surface_create(mbc->display, mbc->win, DefaultVisual(mbc->display, mbc->screen), WIDTH, HEIGHT);
-    mbc->cairo = cairo_create(mbc->cairo_surface);
-
-    return;
-}
-
-void destroy_window(MediaBoxContext *mbc) {
-    // Remove the window, gc, cairo_surface, cairo
-    cairo_destroy(mbc->cairo);
-    cairo_surface_destroy(mbc->cairo_surface);
-    XDestroyWindow(mbc->display, mbc->win);
-    XFreeGC(mbc->display, mbc->gc);
-    mbc->win = NO_WINDOW;
-
-    return;
+static void art_ready(const char *url, gpointer user_data) {
+    MediaBoxContext *mbc = user_data;
+    Player *player = mbc->drawn_player;
+    if (player == NULL || g_strcmp0(player->player_properties->metadata->art_url, url) != 0)
+        return;
+
+    mbc->damage |= DAMAGE(WIDGET_ART);
+    if (mbc->mapped)
+        media_box_queue_redraw(mbc);
 }
 
-MediaBoxContext *media_box_context_new() {
+MediaBoxContext *media_box_context_new(PlayerRegistry *players, const MediaBoxBackend *backend) {
     MediaBoxContext *mbc = calloc(1, sizeof(MediaBoxContext));
-
-    mbc->display = XOpenDisplay(NULL);
-    if (!mbc->display) {
-        fprintf(stderr, "Failed to open X display\n");
+    mbc->players = players;
+    mbc->max_fps = MAX_FRAME_RATE;
+    mbc->backend = backend;
+    mbc->warmup_stage = WARMUP_OFF;
+
+    // The target and everything drawn into it live as long as the context, showing and hiding only maps
+    if (!backend->open(mbc)) {
+        fprintf(stderr, "Failed to open the %s backend\n", backend->name);
         fflush(stderr);
         free(mbc);
         return NULL;
     }
-    mbc->screen = DefaultScreen(mbc->display);
 
+    mbc->event_source = backend->watch(mbc);
 
     mbc->font_large = pango_font_description_from_string("Hack 10");
     mbc->font_normal = pango_font_description_from_string("Hack 8");
     mbc->font_small = pango_font_description_from_string("Hack 6");
 
-    mbc->shown_player_index = 0;
+    mbc->pango = pango_font_map_create_context(pango_cairo_font_map_get_default());
+    // Pick up the font options of the surface we actually render to
+    pango_cairo_update_context(mbc->cairo, mbc->pango);
+    mbc->damage = DAMAGE_ALL;
+    mbc->layouts = layout_cache_new(mbc->pango, LAYOUT_CACHE_SIZE);
+    mbc->art = art_cache_new(ART_SIZE, ART_CACHE_BYTES, art_ready, mbc);
+    // The time label changes every second, it gets its own layout instead of churning the cache
+    mbc->progress_layout = pango_layout_new(mbc->pango);
+    pango_layout_set_font_description(mbc->progress_layout, mbc->font_small);
+
+    mbc->shown_player = NULL;
 
     // Allocate memory for buttons array
     mbc->buttons = calloc(BUTTON_COUNT, sizeof(Button*));
@@ -116,21 +88,49 @@ MediaBoxContext *media_box_context_new() {
                                                  .border = false, .displayed = false,
                                                  .on_click = rotate_shown_player_next};
 
+    // Button labels never change, shape them once up front
+    for (int i = 0; i < BUTTON_COUNT; i++) {
+        Button *btn = mbc->buttons[i];
+        int text_width, text_height;
+
+        btn->layout = pango_layout_new(mbc->pango);
+        pango_layout_set_font_description(btn->layout, mbc->font_normal);
+        pango_layout_set_text(btn->layout, btn->label, -1);
+        pango_layout_get_pixel_size(btn->layout, &text_width, &text_height);
+        btn->label_x = btn->x + (btn->width - text_width) / 2;
+        btn->label_y = btn->y + (btn->height - text_height) / 2;
+    }
+
     return mbc;
 }
 
+static void warm_up_stop(MediaBoxContext *mbc) {
+    if (mbc->warmup_source != 0) {
+        g_source_remove(mbc->warmup_source);
+        mbc->warmup_source = 0;
+    }
+}
+
 void media_box_context_free(MediaBoxContext *mbc) {
+    warm_up_stop(mbc);
+    media_box_cancel_redraw(mbc);
+    if (mbc->progress_source != 0)
+        g_source_remove(mbc->progress_source);
     mbc->shown_player = NULL;
-    if (mbc->win != NO_WINDOW) {
-        destroy_window(mbc);
-    }
+    if (mbc->event_source != 0)
+        g_source_remove(mbc->event_source);
+    mbc->backend->close(mbc);
+    layout_cache_free(mbc->layouts);
+    art_cache_free(mbc->art);
+    g_object_unref(mbc->progress_layout);
+    g_object_unref(mbc->pango);
     pango_font_description_free(mbc->font_large);
     pango_font_description_free(mbc->font_normal);
     pango_font_description_free(mbc->font_small);
-    XCloseDisplay(mbc->display);
 
     if (mbc->buttons) {
         for (int i = 0; i < BUTTON_COUNT; i++) {
+            g_object_unref(mbc->buttons[i]->layout);
             free(mbc->buttons[i]);
         }
         free(mbc->buttons);
@@ -138,30 +138,24 @@ void media_box_context_free(MediaBoxContext *mbc) {
     free(mbc);
 }
 
-void draw_text(MediaBoxContext *mbc, const char *text, int x, int y, FontSize font_size) {
-    PangoLayout *layout = pango_cairo_create_layout(mbc->cairo);
-    pango_layout_set_text(layout, text, -1);
-
-    PangoFontDescription *font;
+static PangoFontDescription *font_for_size(MediaBoxContext *mbc, FontSize font_size) {
     switch(font_size) {
         case FONT_LARGE:
-            font = mbc->font_large;
-            break;
+            return mbc->font_large;
         case FONT_NORMAL:
-            font = mbc->font_normal;
-            break;
+            return mbc->font_normal;
         case FONT_SMALL:
-            font = mbc->font_small;
-            break;
+            return mbc->font_small;
         default:
-            font = mbc->font_normal;
+            return mbc->font_normal;
     }
-    pango_layout_set_font_description(layout, font);
+}
+
+void draw_text(MediaBoxContext *mbc, const char *text, int x, int y, FontSize font_size) {
+    PangoLayout *layout = layout_cache_get(mbc->layouts, text, font_for_size(mbc, font_size));
 
     cairo_move_to(mbc->cairo, x, y);
     pango_cairo_show_layout(mbc->cairo, layout);
-
-    g_object_unref(layout);
     return;
 }
 
@@ -171,83 +165,552 @@ void draw_button(MediaBoxContext *mbc, Button *btn) {
         cairo_stroke(mbc->cairo);
     }
 
-    PangoLayout *layout = pango_cairo_create_layout(mbc->cairo);
-    pango_layout_set_text(layout, btn->label, -1);
-    pango_layout_set_font_description(layout, mbc->font_normal);
+    cairo_move_to(mbc->cairo, btn->label_x, btn->label_y);
+    pango_cairo_show_layout(mbc->cairo, btn->layout);
 
-    int text_width, text_height;
-    pango_layout_get_size(layout, &text_width, &text_height);
+    btn->displayed = true;
+}
 
-    text_width /= PANGO_SCALE;
-    text_height /= PANGO_SCALE;
+typedef struct {
+    int x, y, width, height;
+    FontSize font_size;
+} TextWidget;
+
+// Text is clipped to its widget so a long title cannot bleed into its neighbours
+static const TextWidget text_widgets[WIDGET_BUTTON_FIRST] = {
+    [WIDGET_NAME]   = { .x = 30, .y = 10, .width = TEXT_WIDTH, .height = 16, .font_size = FONT_SMALL },
+    [WIDGET_TITLE]  = { .x = 30, .y = 30, .width = TEXT_WIDTH, .height = 26, .font_size = FONT_LARGE },
+    [WIDGET_ARTIST] = { .x = 30, .y = 60, .width = TEXT_WIDTH, .height = 18, .font_size = FONT_NORMAL },
+    [WIDGET_ALBUM]  = { .x = 30, .y = 80, .width = TEXT_WIDTH, .height = 18, .font_size = FONT_NORMAL },
+};
+
+void media_box_damage(MediaBoxContext *mbc, guint damage) {
+    mbc->damage |= damage;
+}
 
-    int text_x = btn->x + (btn->width - text_width) / 2;
-    int text_y = btn->y + (btn->height - text_height) / 2;
+guint media_box_damage_for_changes(PlayerChanges changes) {
+    guint damage = 0;
+    if (changes & PLAYER_CHANGED_TITLE)
+        damage |= DAMAGE(WIDGET_TITLE);
+    if (changes & PLAYER_CHANGED_ARTIST)
+        damage |= DAMAGE(WIDGET_ARTIST);
+    if (changes & PLAYER_CHANGED_ALBUM)
+        damage |= DAMAGE(WIDGET_ALBUM);
+    if (changes & PLAYER_CHANGED_ART_URL)
+        damage |= DAMAGE(WIDGET_ART);
+    if (changes & PLAYER_CHANGED_PROGRESS)
+        damage |= DAMAGE(WIDGET_PROGRESS);
+    // Capability changes show up as buttons appearing or disappearing, draw_media_box() picks those up itself
+    return damage;
+}
 
-    cairo_move_to(mbc->cairo, text_x, text_y);
-    pango_cairo_show_layout(mbc->cairo, layout);
+static void widget_rectangle(MediaBoxContext *mbc, Widget widget, cairo_rectangle_int_t *rect) {
+    if (widget >= WIDGET_BUTTON_FIRST) {
+        // Borders are stroked on the edge of the button and spill a pixel outside of it
+        Button *btn = mbc->buttons[widget - WIDGET_BUTTON_FIRST];
+        *rect = (cairo_rectangle_int_t){ btn->x - 1, btn->y - 1, btn->width + 2, btn->height + 2 };
+    } else if (widget == WIDGET_ART) {
+        *rect = (cairo_rectangle_int_t){ ART_X, ART_Y, ART_SIZE, ART_SIZE };
+    } else if (widget == WIDGET_PROGRESS) {
+        *rect = (cairo_rectangle_int_t){ 30, PROGRESS_Y, ART_X + ART_SIZE - 30, PROGRESS_HEIGHT };
+    } else {
+        const TextWidget *tw = &text_widgets[widget];
+        *rect = (cairo_rectangle_int_t){ tw->x, tw->y, tw->width, tw->height };
+    }
+}
 
-    g_object_unref(layout);
-    btn->displayed = true;
+static void present_rectangle(MediaBoxContext *mbc, const cairo_rectangle_int_t *rect) {
+    // Backends without a window render straight into the back buffer
+    if (mbc->window_cairo == NULL)
+        return;
+
+    cairo_set_source_surface(mbc->window_cairo, mbc->back_buffer, 0, 0);
+    cairo_rectangle(mbc->window_cairo, rect->x, rect->y, rect->width, rect->height);
+    cairo_fill(mbc->window_cairo);
+}
+
+static void draw_text_widget(MediaBoxContext *mbc, Widget widget, const char *text) {
+    const TextWidget *tw = &text_widgets[widget];
+
+    cairo_save(mbc->cairo);
+    cairo_rectangle(mbc->cairo, tw->x, tw->y, tw->width, tw->height);
+    cairo_clip(mbc->cairo);
+    cairo_set_source_rgba(mbc->cairo, 0.23, 0.23, 0.23, 1.0);
+    cairo_paint(mbc->cairo);
+    if (text != NULL) {
+        cairo_set_source_rgba(mbc->cairo, 1.0, 1.0, 1.0, 1.0);
+        draw_text(mbc, text, tw->x, tw->y, tw->font_size);
+    }
+    cairo_restore(mbc->cairo);
+}
+
+// Returns how many round trips the operation started at start took
+static guint64 count_op(MediaBoxContext *mbc, MediaBoxOp op, guint64 start) {
+    guint64 round_trips = mbc->round_trips - start;
+    mbc->op_stats[op].count++;
+    mbc->op_stats[op].round_trips += round_trips;
+    return round_trips;
+}
+
+// Mapping makes the server send an Expose, which copies the back buffer over
+static guint64 media_box_show(MediaBoxContext *mbc) {
+    if (mbc->mapped)
+        return 0;
+
+    guint64 start = mbc->round_trips;
+    mbc->mapped = true;
+    mbc->backend->map(mbc);
+    return count_op(mbc, MEDIA_BOX_OP_SHOW, start);
+}
+
+void media_box_forget_player(MediaBoxContext *mbc, Player *player) {
+    if (mbc->shown_player == player)
+        mbc->shown_player = NULL;
+    if (mbc->drawn_player == player)
+        mbc->drawn_player = NULL;
 }
 
-void draw_media_box(MediaBoxContext *mbc, GQueue *players) {
-    if (mbc->win == NO_WINDOW) {
-        create_window(mbc);
+static void draw_art_widget(MediaBoxContext *mbc, const char *url) {
+    cairo_save(mbc->cairo);
+    cairo_rectangle(mbc->cairo, ART_X, ART_Y, ART_SIZE, ART_SIZE);
+    cairo_clip(mbc->cairo);
+    cairo_set_source_rgba(mbc->cairo, 0.23, 0.23, 0.23, 1.0);
+    cairo_paint(mbc->cairo);
+
+    // A miss queues the decode, art_ready() damages the widget again once the surface exists
+    cairo_surface_t *art = url != NULL ? art_cache_lookup(mbc->art, url) : NULL;
+    if (art != NULL) {
+        int width = cairo_image_surface_get_width(art);
+        int height = cairo_image_surface_get_height(art);
+        cairo_set_source_surface(mbc->cairo, art, ART_X + (ART_SIZE - width) / 2, ART_Y + (ART_SIZE - height) / 2);
+        cairo_paint(mbc->cairo);
     }
-    XClearWindow(mbc->display, mbc->win);
+    cairo_restore(mbc->cairo);
+}
+
+static void format_time(char *buf, size_t size, gint64 usec) {
+    gint64 seconds = usec / G_USEC_PER_SEC;
+    if (seconds >= 3600) {
+        snprintf(buf, size, "%d:%02d:%02d", (int)(seconds / 3600), (int)(seconds / 60 % 60), (int)(seconds % 60));
+    } else {
+        snprintf(buf, size, "%d:%02d", (int)(seconds / 60), (int)(seconds % 60));
+    }
+}
+
+static void draw_progress_widget(MediaBoxContext *mbc, PlayerProperties *props) {
+    cairo_rectangle_int_t rect;
+    widget_rectangle(mbc, WIDGET_PROGRESS, &rect);
+
+    cairo_save(mbc->cairo);
+    cairo_rectangle(mbc->cairo, rect.x, rect.y, rect.width, rect.height);
+    cairo_clip(mbc->cairo);
     cairo_set_source_rgba(mbc->cairo, 0.23, 0.23, 0.23, 1.0);
     cairo_paint(mbc->cairo);
+
+    gint64 length = props->metadata->length;
+    gint64 position = player_position(props, g_get_monotonic_time());
+    if (length > 0) {
+        int bar_y = PROGRESS_Y + (PROGRESS_HEIGHT - 3) / 2;
+        cairo_set_source_rgba(mbc->cairo, 0.4, 0.4, 0.4, 1.0);
+        cairo_rectangle(mbc->cairo, 30, bar_y, TEXT_WIDTH, 3);
+        cairo_fill(mbc->cairo);
+        cairo_set_source_rgba(mbc->cairo, 1.0, 1.0, 1.0, 1.0);
+        cairo_rectangle(mbc->cairo, 30, bar_y, (int)(TEXT_WIDTH * position / length), 3);
+        cairo_fill(mbc->cairo);
+    }
+
+    char elapsed[16], total[16], label[40];
+    format_time(elapsed, sizeof(elapsed), position);
+    if (length > 0) {
+        format_time(total, sizeof(total), length);
+        snprintf(label, sizeof(label), "%s / %s", elapsed, total);
+    } else {
+        g_strlcpy(label, elapsed, sizeof(label));
+    }
+
+    int text_width, text_height;
+    pango_layout_set_text(mbc->progress_layout, label, -1);
+    pango_layout_get_pixel_size(mbc->progress_layout, &text_width, &text_height);
     cairo_set_source_rgba(mbc->cairo, 1.0, 1.0, 1.0, 1.0);
+    cairo_move_to(mbc->cairo, ART_X + ART_SIZE - text_width, PROGRESS_Y + (PROGRESS_HEIGHT - text_height) / 2);
+    pango_cairo_show_layout(mbc->cairo, mbc->progress_layout);
+    cairo_restore(mbc->cairo);
+}
 
-    for (int i = 0; i < BUTTON_COUNT; i++) {
-        mbc->buttons[i]->displayed = false;
+static gboolean progress_callback(gpointer user_data) {
+    MediaBoxContext *mbc = user_data;
+    mbc->progress_source = 0;
+    mbc->damage |= DAMAGE(WIDGET_PROGRESS);
+    media_box_queue_redraw(mbc);
+    return G_SOURCE_REMOVE;
+}
+
+static void progress_stop(MediaBoxContext *mbc) {
+    if (mbc->progress_source != 0) {
+        g_source_remove(mbc->progress_source);
+        mbc->progress_source = 0;
+    }
+}
+
+// The position is extrapolated locally, so the only timer is the one that repaints it, and it only
+// runs while there is something moving on screen
+static void progress_schedule(MediaBoxContext *mbc, Player *player) {
+    progress_stop(mbc);
+    if (player == NULL || !mbc->mapped)
+        return;
+
+    PlayerProperties *props = player->player_properties;
+    if (props->playback_status != PLAYBACK_PLAYING || props->rate <= 0)
+        return;
+
+    // Wake up when the label ticks over to the next second, or earlier if the bar grows a pixel before that
+    gint64 position = player_position(props, g_get_monotonic_time());
+    gint64 until = G_USEC_PER_SEC - position % G_USEC_PER_SEC;
+    gint64 per_pixel = props->metadata->length / TEXT_WIDTH;
+    if (per_pixel > 0)
+        until = MIN(until, per_pixel - position % per_pixel);
+
+    mbc->progress_source = g_timeout_add((guint)(until / props->rate / 1000) + 1, progress_callback, mbc);
+}
+
+static const char *warm_up_state(MediaBoxContext *mbc) {
+    if (mbc->warmup_stage == WARMUP_OFF)
+        return "off";
+    return mbc->warmup_stage == WARMUP_DONE ? "done" : "unfinished";
+}
+
+static const char *warmup_stage_names[WARMUP_DONE] = {
+    [WARMUP_FONT_LARGE] = "font large",
+    [WARMUP_FONT_NORMAL] = "font normal",
+    [WARMUP_FONT_SMALL] = "font small",
+    [WARMUP_GLYPHS_LARGE] = "glyphs large",
+    [WARMUP_GLYPHS_NORMAL] = "glyphs normal",
+    [WARMUP_GLYPHS_SMALL] = "glyphs small",
+    [WARMUP_FRAME] = "frame",
+};
+
+// From the show being queued to its frame being flushed
+static void report_show(MediaBoxContext *mbc) {
+    gint64 latency = g_get_monotonic_time() - mbc->show_requested;
+    mbc->show_requested = 0;
+    if (mbc->op_stats[MEDIA_BOX_OP_SHOW].count == 1) {
+        g_info("first show took %" G_GINT64_FORMAT "us (warm-up %s)", latency, warm_up_state(mbc));
+        // The max is what a command arriving during that step could have waited for
+        for (int i = 0; i < MIN(mbc->warmup_stage, WARMUP_DONE); i++) {
+            g_info("warm-up %s: %" G_GINT64_FORMAT "us, longest callback %" G_GINT64_FORMAT "us",
+                   warmup_stage_names[i], mbc->warmup_stage_time[i], mbc->warmup_stage_max[i]);
+        }
+    } else {
+        g_debug("show took %" G_GINT64_FORMAT "us", latency);
     }
+}
 
-    Player *player = g_queue_peek_nth(players, mbc->shown_player_index);
+void draw_media_box(MediaBoxContext *mbc, PlayerRegistry *players) {
+    guint64 start = mbc->round_trips;
+    // Whatever the warm-up had left is about to happen anyway
+    warm_up_stop(mbc);
+    Player *player = mbc->shown_player;
+    if (player == NULL) {
+        player = player_registry_first(players);
+    }
     mbc->shown_player = player;
+    if (player != mbc->drawn_player) {
+        mbc->damage = DAMAGE_ALL;
+        mbc->drawn_player = player;
+    }
+
+    // A button that has to appear or disappear needs its area repainted whatever else changed
+    bool wanted[BUTTON_COUNT] = {0};
     if (player != NULL) {
-        // Draw buttons
-        PlayerMetadata *md = player->player_properties->metadata;
-        if (player->name != NULL) {
-            char *player_name = title_case(g_strdup(player->name));
-            draw_text(mbc, player_name, 30, 10, FONT_SMALL);
-            g_free(player_name);
+        PlayerProperties *props = player->player_properties;
+        wanted[BUTTON_PLAYER_PREV] = player_registry_live_count(players) > 1;
+        wanted[BUTTON_PLAYER_NEXT] = player_registry_live_count(players) > 1;
+        wanted[BUTTON_PREVIOUS] = player_has_flag(props, PLAYER_FLAG_CAN_GO_PREVIOUS);
+        wanted[BUTTON_PLAY_PAUSE] = player_has_flag(props, PLAYER_FLAG_CAN_PLAY) && player_has_flag(props, PLAYER_FLAG_CAN_PAUSE);
+        wanted[BUTTON_NEXT] = player_has_flag(props, PLAYER_FLAG_CAN_GO_NEXT);
+    }
+    for (int i = 0; i < BUTTON_COUNT; i++) {
+        if (wanted[i] != mbc->buttons[i]->displayed)
+            mbc->damage |= DAMAGE_BUTTON(i);
+    }
+
+    guint damage = mbc->damage;
+    mbc->damage = 0;
+    if (damage == 0) {
+        media_box_show(mbc);
+        if (mbc->progress_source == 0)
+            progress_schedule(mbc, player);
+        if (mbc->show_requested != 0)
+            report_show(mbc);
+        return;
+    }
+
+    cairo_rectangle_int_t rect;
+    cairo_set_source_rgba(mbc->cairo, 0.23, 0.23, 0.23, 1.0);
+    if (damage == DAMAGE_ALL) {
+        cairo_paint(mbc->cairo);
+    } else {
+        for (int i = 0; i < BUTTON_COUNT; i++) {
+            if (damage & DAMAGE_BUTTON(i)) {
+                widget_rectangle(mbc, WIDGET_BUTTON_FIRST + i, &rect);
+                cairo_rectangle(mbc->cairo, rect.x, rect.y, rect.width, rect.height);
+                cairo_fill(mbc->cairo);
+            }
+        }
+    }
+    cairo_set_source_rgba(mbc->cairo, 1.0, 1.0, 1.0, 1.0);
+
+    for (int i = 0; i < BUTTON_COUNT; i++) {
+        if (damage & DAMAGE_BUTTON(i)) {
+            mbc->buttons[i]->displayed = false;
+            if (wanted[i])
+                draw_button(mbc, mbc->buttons[i]);
         }
+    }
 
-        if (g_queue_get_length(players) > 1) {
-            draw_button(mbc, mbc->buttons[BUTTON_PLAYER_PREV]);
-            draw_button(mbc, mbc->buttons[BUTTON_PLAYER_NEXT]);
+    if (player != NULL) {
+        PlayerMetadata *md = player->player_properties->metadata;
+        if (damage & DAMAGE(WIDGET_NAME))
+            draw_text_widget(mbc, WIDGET_NAME, player->display_name);
+        if (damage & DAMAGE(WIDGET_TITLE))
+            draw_text_widget(mbc, WIDGET_TITLE, md->title);
+        if (damage & DAMAGE(WIDGET_ARTIST))
+            draw_text_widget(mbc, WIDGET_ARTIST, md->artist);
+        if (damage & DAMAGE(WIDGET_ALBUM))
+            draw_text_widget(mbc, WIDGET_ALBUM, md->album);
+        if (damage & DAMAGE(WIDGET_ART))
+            draw_art_widget(mbc, md->art_url);
+        if (damage & DAMAGE(WIDGET_PROGRESS))
+            draw_progress_widget(mbc, player->player_properties);
+    } else {
+        const char *no_players = "No Players Detected";
+        draw_text(mbc, no_players, 30, 20, FONT_LARGE);
+    }
+
+    // Copy only what was repainted over to the window
+    cairo_surface_flush(mbc->back_buffer);
+    if (damage == DAMAGE_ALL) {
+        rect = (cairo_rectangle_int_t){ 0, 0, WIDTH, HEIGHT };
+        present_rectangle(mbc, &rect);
+    } else {
+        for (Widget w = 0; w < WIDGET_COUNT; w++) {
+            if (damage & DAMAGE(w)) {
+                widget_rectangle(mbc, w, &rect);
+                present_rectangle(mbc, &rect);
+            }
         }
+    }
+    // Mapping is accounted as a show, not as part of the frame
+    start += media_box_show(mbc);
+    progress_schedule(mbc, player);
+    mbc->backend->flush(mbc);
+    count_op(mbc, MEDIA_BOX_OP_REDRAW, start);
+    if (mbc->show_requested != 0)
+        report_show(mbc);
+}
 
-        if (md->title != NULL)
-            draw_text(mbc, md->title, 30, 30, FONT_LARGE);
+static gboolean frame_callback(gpointer user_data) {
+    MediaBoxContext *mbc = user_data;
+    mbc->frame_source = 0;
+    mbc->last_frame = g_get_monotonic_time();
+    draw_media_box(mbc, mbc->players);
+    return G_SOURCE_REMOVE;
+}
 
-        if (md->artist != NULL)
-            draw_text(mbc, md->artist, 30, 60, FONT_NORMAL);
+void media_box_set_max_fps(MediaBoxContext *mbc, int max_fps) {
+    mbc->max_fps = max_fps > 0 ? max_fps : MAX_FRAME_RATE;
+}
 
-        if (md->album != NULL)
-            draw_text(mbc, md->album, 30, 80, FONT_NORMAL);
+void media_box_queue_redraw(MediaBoxContext *mbc) {
+    if (!mbc->mapped && mbc->show_requested == 0)
+        mbc->show_requested = g_get_monotonic_time();
+    if (mbc->frame_source != 0)
+        return;
+
+    // An idle source runs after every event already pending in this main loop iteration, so a burst
+    // of signals collapses into the one frame. Past that, frames are spaced at least 1/max_fps apart.
+    gint64 wait = mbc->last_frame + G_USEC_PER_SEC / mbc->max_fps - g_get_monotonic_time();
+    if (wait <= 0) {
+        mbc->frame_source = g_idle_add(frame_callback, mbc);
+    } else {
+        mbc->frame_source = g_timeout_add((wait + 999) / 1000, frame_callback, mbc);
+    }
+}
 
-        if (player->player_properties->can_go_previous)
-            draw_button(mbc, mbc->buttons[BUTTON_PREVIOUS]);
+void media_box_cancel_redraw(MediaBoxContext *mbc) {
+    mbc->show_requested = 0;
+    if (mbc->frame_source != 0) {
+        g_source_remove(mbc->frame_source);
+        mbc->frame_source = 0;
+    }
+}
 
-        if (player->player_properties->can_play && player->player_properties->can_pause) {
-            draw_button(mbc, mbc->buttons[BUTTON_PLAY_PAUSE]);
+// Everything the box can print is ASCII and Latin-1, shaped a chunk at a time. Returns the character to
+// continue from, 0 once the range is done.
+static gunichar shape_glyphs(MediaBoxContext *mbc, FontSize font_size, gunichar c) {
+    GString *text = g_string_sized_new(WARMUP_GLYPH_CHUNK * 2);
+    for (int n = 0; n < WARMUP_GLYPH_CHUNK && c <= 0xff; c++) {
+        if (c < 0x7f || c >= 0xa0) {
+            g_string_append_unichar(text, c);
+            n++;
         }
+    }
 
-        if (player->player_properties->can_go_next)
-            draw_button(mbc, mbc->buttons[BUTTON_NEXT]);
+    PangoLayout *layout = pango_layout_new(mbc->pango);
+    pango_layout_set_font_description(layout, font_for_size(mbc, font_size));
+    pango_layout_set_width(layout, WIDTH * PANGO_SCALE);
+    pango_layout_set_wrap(layout, PANGO_WRAP_CHAR);
+    pango_layout_set_text(layout, text->str, text->len);
+    g_string_free(text, true);
 
-    } else {
-        const char *no_players = "No Players Detected";
-        draw_text(mbc, no_players, 30, 20, FONT_LARGE);
+    // Showing it rasterizes the glyphs, and uploads them to the server on the X backends
+    cairo_move_to(mbc->cairo, 0, 0);
+    pango_cairo_show_layout(mbc->cairo, layout);
+    g_object_unref(layout);
+    return c <= 0xff ? c : 0;
+}
+
+// Paints a whole box into the back buffer and copies it to the still unmapped window
+static void render_empty_frame(MediaBoxContext *mbc) {
+    cairo_set_source_rgba(mbc->cairo, 0.23, 0.23, 0.23, 1.0);
+    cairo_paint(mbc->cairo);
+    cairo_set_source_rgba(mbc->cairo, 1.0, 1.0, 1.0, 1.0);
+    for (int i = 0; i < BUTTON_COUNT; i++) {
+        draw_button(mbc, mbc->buttons[i]);
+        mbc->buttons[i]->displayed = false;
+    }
+    draw_text(mbc, "No Players Detected", 30, 20, FONT_LARGE);
+
+    cairo_surface_flush(mbc->back_buffer);
+    cairo_rectangle_int_t rect = { 0, 0, WIDTH, HEIGHT };
+    present_rectangle(mbc, &rect);
+    mbc->backend->flush(mbc);
+}
+
+static gboolean warm_up_callback(gpointer user_data) {
+    MediaBoxContext *mbc = user_data;
+    gint64 start = g_get_monotonic_time();
+    WarmupStage stage = mbc->warmup_stage;
+    bool stage_done = true;
+
+    switch (stage) {
+    case WARMUP_FONT_LARGE:
+    case WARMUP_FONT_NORMAL:
+    case WARMUP_FONT_SMALL: {
+        // The first one also pays for fontconfig reading its configuration and cache. That happens in one
+        // go inside fontconfig and cannot be split, it is the longest callback of the warm-up.
+        PangoFont *font = pango_context_load_font(mbc->pango, font_for_size(mbc, FONT_LARGE + stage - WARMUP_FONT_LARGE));
+        if (font != NULL)
+            g_object_unref(font);
+        break;
+    }
+    case WARMUP_GLYPHS_LARGE:
+    case WARMUP_GLYPHS_NORMAL:
+    case WARMUP_GLYPHS_SMALL:
+        mbc->warmup_glyph = shape_glyphs(mbc, FONT_LARGE + stage - WARMUP_GLYPHS_LARGE,
+                                         mbc->warmup_glyph != 0 ? mbc->warmup_glyph : 0x20);
+        stage_done = mbc->warmup_glyph == 0;
+        break;
+    case WARMUP_FRAME:
+        render_empty_frame(mbc);
+        break;
+    default:
+        break;
+    }
+
+    // What went into the back buffer is not a real frame
+    mbc->damage = DAMAGE_ALL;
+    gint64 took = g_get_monotonic_time() - start;
+    mbc->warmup_time += took;
+    mbc->warmup_stage_time[stage] += took;
+    mbc->warmup_stage_max[stage] = MAX(mbc->warmup_stage_max[stage], took);
+    if (!stage_done)
+        return G_SOURCE_CONTINUE;
+
+    g_debug("warm-up %s took %" G_GINT64_FORMAT "us", warmup_stage_names[stage], mbc->warmup_stage_time[stage]);
+    mbc->warmup_stage++;
+    if (mbc->warmup_stage == WARMUP_DONE) {
+        g_info("warm-up done in %" G_GINT64_FORMAT "us", mbc->warmup_time);
+        mbc->warmup_source = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+// Does what the first show would otherwise pay for in short idle callbacks at low priority, so bus traffic
+// and commands only ever wait for the one in progress. Loading the first font is the exception that can
+// take tens of milliseconds, see warm_up_callback(). A draw before it is done stops it.
+void media_box_warm_up(MediaBoxContext *mbc) {
+    if (mbc->warmup_stage != WARMUP_OFF)
+        return;
+
+    mbc->warmup_stage = WARMUP_FONT_LARGE;
+    mbc->warmup_source = g_idle_add_full(G_PRIORITY_LOW, warm_up_callback, mbc, NULL);
+}
+
+// count is how many more Expose events of the same series follow, as the server reports it
+void media_box_expose(MediaBoxContext *mbc, int x, int y, int width, int height, int count) {
+    if (mbc->window_cairo == NULL)
+        return;
+
+    // Grow the pending area until the last event of the series, then copy it in one go
+    int x1 = x, y1 = y;
+    int x2 = x + width, y2 = y + height;
+    if (mbc->expose_pending) {
+        x1 = MIN(x1, mbc->expose_area.x);
+        y1 = MIN(y1, mbc->expose_area.y);
+        x2 = MAX(x2, mbc->expose_area.x + mbc->expose_area.width);
+        y2 = MAX(y2, mbc->expose_area.y + mbc->expose_area.height);
+    }
+    mbc->expose_area = (cairo_rectangle_int_t){ x1, y1, x2 - x1, y2 - y1 };
+    mbc->expose_pending = true;
+
+    if (count > 0)
+        return;
+
+    present_rectangle(mbc, &mbc->expose_area);
+    mbc->expose_pending = false;
+    mbc->backend->flush(mbc);
+}
+
+void media_box_click(MediaBoxContext *mbc, int x, int y) {
+    for (int i = 0; i < BUTTON_COUNT; i++) {
+        Button *btn = mbc->buttons[i];
+        if (!btn->displayed)
+            continue;
+
+        if (x >= btn->x && x <= (btn->x + btn->width) && y >= btn->y && y <= (btn->y + btn->height)) {
+            g_info("Button %s clicked.", btn->label);
+            if (mbc->clicked != NULL)
+                mbc->clicked(mbc, btn, mbc->clicked_data);
+            return;
+        }
+    }
+}
+
+// Only the round trips the backend makes itself are counted. Those cairo makes inside its own calls, such
+// as the surface and format queries of create_similar() and the first draw, are not: on the Xlib backend
+// they do not show up anywhere we could count them. The numbers are a lower bound, compare backends with
+// the wall time of the show as well.
+void media_box_print_stats(MediaBoxContext *mbc) {
+    static const char *op_names[MEDIA_BOX_OP_COUNT] = { "show", "hide", "redraw" };
+    for (int i = 0; i < MEDIA_BOX_OP_COUNT; i++) {
+        MediaBoxOpStats *stats = &mbc->op_stats[i];
+        g_info("%s %s: n=%" G_GUINT64_FORMAT " backend round trips=%" G_GUINT64_FORMAT " (cairo's not counted)", mbc->backend->name, op_names[i],
+               stats->count, stats->round_trips);
     }
-    XMapWindow(mbc->display, mbc->win);
-    XFlush(mbc->display);
 }
 
 void remove_media_box(MediaBoxContext *mbc) {
-    destroy_window(mbc);
-    XFlush(mbc->display);
+    if (!mbc->mapped)
+        return;
+
+    // The position keeps moving while hidden, whatever the back buffer holds is stale by the next show
+    progress_stop(mbc);
+    mbc->damage |= DAMAGE(WIDGET_PROGRESS);
+    mbc->expose_pending = false;
+    mbc->mapped = false;
+    guint64 start = mbc->round_trips;
+    mbc->backend->unmap(mbc);
+    count_op(mbc, MEDIA_BOX_OP_HIDE, start);
 }
@@ -4,12 +4,22 @@
 #include <X11/Xlib.h>
 #include <cairo/cairo.h>
 #include "player.h"
+#include "registry.h"
+#include "layoutcache.h"
+#include "art.h"
 #include <pango/pangocairo.h>
 #include <X11/extensions/Xinerama.h>
 
 #define WIDTH 500
 #define HEIGHT 150
 #define BUTTON_COUNT 5
+#define MAX_FRAME_RATE 60
+#define ART_X (WIDTH - 30 - ART_SIZE)
+#define ART_Y 15
+#define TEXT_WIDTH (ART_X - 40)
+#define PROGRESS_Y 98
+#define PROGRESS_HEIGHT 10
+#define WARMUP_GLYPH_CHUNK 32
 
 typedef enum {
     FONT_LARGE,
@@ -25,31 +35,155 @@ typedef enum {
     BUTTON_PLAYER_NEXT = 4,
 } Buttons;
 
+// Independently repaintable regions of the box. Buttons follow the text widgets in Buttons order.
+typedef enum {
+    WIDGET_NAME,
+    WIDGET_TITLE,
+    WIDGET_ARTIST,
+    WIDGET_ALBUM,
+    WIDGET_ART,
+    WIDGET_PROGRESS,
+    WIDGET_BUTTON_FIRST,
+    WIDGET_COUNT = WIDGET_BUTTON_FIRST + BUTTON_COUNT,
+} Widget;
+
+#define DAMAGE(widget) (1u << (widget))
+#define DAMAGE_BUTTON(button) DAMAGE(WIDGET_BUTTON_FIRST + (button))
+#define DAMAGE_ALL ((1u << WIDGET_COUNT) - 1)
+
 typedef struct {
     int x, y, width, height;
     char label[20];
     bool border;
     bool displayed;
     void (*on_click)(void *);
+    PangoLayout *layout;
+    int label_x, label_y;
 } Button;
 
+typedef enum {
+    ATOM_WM_STATE,
+    ATOM_WM_STATE_ABOVE,
+    ATOM_WM_WINDOW_TYPE,
+    ATOM_WM_WINDOW_TYPE_DIALOG,
+    ATOM_COUNT,
+} Atoms;
+
+typedef struct MediaBoxContext MediaBoxContext;
+
+// Where frames end up. open() has to provide back_buffer and cairo, which all drawing goes to, and
+// window_cairo if there is a window to present damaged areas to. watch() attaches a main loop source that
+// feeds window events to media_box_expose() and media_box_click(), it returns 0 without a window.
+typedef struct {
+    const char *name;
+    bool (*open)(MediaBoxContext *mbc);
+    void (*close)(MediaBoxContext *mbc);
+    void (*map)(MediaBoxContext *mbc);
+    void (*unmap)(MediaBoxContext *mbc);
+    void (*flush)(MediaBoxContext *mbc);
+    guint (*watch)(MediaBoxContext *mbc);
+} MediaBoxBackend;
+
+// An override-redirect X window through Xlib, always built and the fallback for the others
+extern const MediaBoxBackend media_box_xlib_backend;
+#ifdef HAVE_XCB
+// The same window through XCB, nothing it sends waits on a reply (make XCB=1)
+extern const MediaBoxBackend media_box_xcb_backend;
+#endif
+// An in-memory image surface and no window, for render benchmarks and golden images
+extern const MediaBoxBackend media_box_image_backend;
+
+typedef void (*MediaBoxClickFunc)(MediaBoxContext *mbc, Button *btn, gpointer user_data);
+
+typedef enum {
+    MEDIA_BOX_OP_SHOW,
+    MEDIA_BOX_OP_HIDE,
+    MEDIA_BOX_OP_REDRAW,
+    MEDIA_BOX_OP_COUNT,
+} MediaBoxOp;
+
 typedef struct {
+    guint64 count;
+    guint64 round_trips;
+} MediaBoxOpStats;
+
+// Steps of media_box_warm_up(). Font steps take one idle callback each, glyph steps one per
+// WARMUP_GLYPH_CHUNK characters.
+typedef enum {
+    WARMUP_OFF = -1,
+    WARMUP_FONT_LARGE,
+    WARMUP_FONT_NORMAL,
+    WARMUP_FONT_SMALL,
+    WARMUP_GLYPHS_LARGE,
+    WARMUP_GLYPHS_NORMAL,
+    WARMUP_GLYPHS_SMALL,
+    WARMUP_FRAME,
+    WARMUP_DONE,
+} WarmupStage;
+
+struct MediaBoxContext {
+    const MediaBoxBackend *backend;
+    // Whatever the backend keeps beyond the Xlib fields below
+    gpointer backend_data;
+    guint event_source;
+    // Bumped by the backend whenever it has to wait for the server, cairo's own waits are not included,
+    // see media_box_print_stats()
+    guint64 round_trips;
+    MediaBoxOpStats op_stats[MEDIA_BOX_OP_COUNT];
+    // When the pending show was queued, 0 if none is
+    gint64 show_requested;
+    WarmupStage warmup_stage;
+    guint warmup_source;
+    // Next character the current glyph step shapes
+    gunichar warmup_glyph;
+    gint64 warmup_time;
+    // Total and longest single callback per step, reported with the first show
+    gint64 warmup_stage_time[WARMUP_DONE];
+    gint64 warmup_stage_max[WARMUP_DONE];
+    MediaBoxClickFunc clicked;
+    gpointer clicked_data;
     Display *display;
     Window win;
     GC gc;
     int screen;
+    Atom atoms[ATOM_COUNT];
+    bool mapped;
     cairo_surface_t *cairo_surface;
+    cairo_t *window_cairo;
+    cairo_surface_t *back_buffer;
     cairo_t *cairo;
     PangoFontDescription *font_large;
     PangoFontDescription *font_normal;
     PangoFontDescription *font_small;
+    PangoContext *pango;
+    LayoutCache *layouts;
+    ArtCache *art;
+    PlayerRegistry *players;
     Player *shown_player;
-    int shown_player_index;
+    Player *drawn_player;
+    guint damage;
+    cairo_rectangle_int_t expose_area;
+    bool expose_pending;
+    int max_fps;
+    guint frame_source;
+    gint64 last_frame;
+    PangoLayout *progress_layout;
+    guint progress_source;
     Button **buttons;
-} MediaBoxContext;
+};
 
-MediaBoxContext *media_box_context_new();
+MediaBoxContext *media_box_context_new(PlayerRegistry *players, const MediaBoxBackend *backend);
 void media_box_context_free(MediaBoxContext *mbc);
-void draw_media_box(MediaBoxContext *mbc, GQueue *players);
+void media_box_damage(MediaBoxContext *mbc, guint damage);
+void media_box_forget_player(MediaBoxContext *mbc, Player *player);
+guint media_box_damage_for_changes(PlayerChanges changes);
+void draw_media_box(MediaBoxContext *mbc, PlayerRegistry *players);
+void media_box_set_max_fps(MediaBoxContext *mbc, int max_fps);
+void media_box_queue_redraw(MediaBoxContext *mbc);
+void media_box_cancel_redraw(MediaBoxContext *mbc);
+void media_box_expose(MediaBoxContext *mbc, int x, int y, int width, int height, int count);
+void media_box_click(MediaBoxContext *mbc, int x, int y);
+void media_box_print_stats(MediaBoxContext *mbc);
+void media_box_warm_up(MediaBoxContext *mbc);
 void remove_media_box(MediaBoxContext *mbc);
 #endif
@@ -0,0 +1,34 @@
+#include "mediabox.h"
+
+static bool image_open(MediaBoxContext *mbc) {
+    // Same content as the pixmap the Xlib backend gets on a 24 bit visual
+    mbc->back_buffer = cairo_image_surface_create(CAIRO_FORMAT_RGB24, WIDTH, HEIGHT);
+    if (cairo_surface_status(mbc->back_buffer) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(mbc->back_buffer);
+        return false;
+    }
+    mbc->cairo = cairo_create(mbc->back_buffer);
+    return true;
+}
+
+static void image_close(MediaBoxContext *mbc) {
+    cairo_destroy(mbc->cairo);
+    cairo_surface_destroy(mbc->back_buffer);
+}
+
+static void image_nothing(MediaBoxContext *mbc) {
+}
+
+static guint image_watch(MediaBoxContext *mbc) {
+    return 0;
+}
+
+const MediaBoxBackend media_box_image_backend = {
+    .name = "image",
+    .open = image_open,
+    .close = image_close,
+    .map = image_nothing,
+    .unmap = image_nothing,
+    .flush = image_nothing,
+    .watch = image_watch,
+};
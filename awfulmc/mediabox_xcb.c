@@ -0,0 +1,256 @@
+#include "mediabox.h"
+#include <cairo/cairo-xcb.h>
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    xcb_connection_t *con;
+    xcb_screen_t *screen;
+    xcb_window_t win;
+    xcb_atom_t atoms[ATOM_COUNT];
+    // Sent at open, collected when the window is first mapped, by when the replies have long arrived
+    xcb_intern_atom_cookie_t atom_cookies[ATOM_COUNT];
+    bool atoms_pending;
+} XcbBackend;
+
+// Waiting on the fd alone misses events xcb already read off the socket while collecting something else,
+// so prepare() looks into its queue first
+typedef struct {
+    GSource source;
+    MediaBoxContext *mbc;
+    gpointer fd_tag;
+    xcb_generic_event_t *queued;
+} XcbEventSource;
+
+static xcb_visualtype_t *find_visual(xcb_screen_t *screen, xcb_visualid_t id) {
+    for (xcb_depth_iterator_t depth = xcb_screen_allowed_depths_iterator(screen); depth.rem; xcb_depth_next(&depth)) {
+        xcb_visualtype_iterator_t visual = xcb_depth_visuals_iterator(depth.data);
+        for (; visual.rem; xcb_visualtype_next(&visual)) {
+            if (visual.data->visual_id == id)
+                return visual.data;
+        }
+    }
+    return NULL;
+}
+
+static void request_atoms(XcbBackend *xcb) {
+    const char *atom_names[ATOM_COUNT] = {
+        [ATOM_WM_STATE] = "_NET_WM_STATE",
+        [ATOM_WM_STATE_ABOVE] = "_NET_WM_STATE_ABOVE",
+        [ATOM_WM_WINDOW_TYPE] = "_NET_WM_WINDOW_TYPE",
+        [ATOM_WM_WINDOW_TYPE_DIALOG] = "_NET_WM_WINDOW_TYPE_DIALOG",
+    };
+    for (int i = 0; i < ATOM_COUNT; i++)
+        xcb->atom_cookies[i] = xcb_intern_atom(xcb->con, false, strlen(atom_names[i]), atom_names[i]);
+    xcb->atoms_pending = true;
+}
+
+// Only blocks, and counts a round trip, for a reply that has not come in yet
+static void collect_atoms(MediaBoxContext *mbc, XcbBackend *xcb) {
+    for (int i = 0; i < ATOM_COUNT; i++) {
+        xcb_intern_atom_reply_t *reply = NULL;
+        xcb_generic_error_t *error = NULL;
+        if (!xcb_poll_for_reply(xcb->con, xcb->atom_cookies[i].sequence, (void **)&reply, &error)) {
+            mbc->round_trips++;
+            reply = xcb_intern_atom_reply(xcb->con, xcb->atom_cookies[i], &error);
+        }
+
+        xcb->atoms[i] = reply != NULL ? reply->atom : XCB_ATOM_NONE;
+        mbc->atoms[i] = xcb->atoms[i];
+        free(reply);
+        free(error);
+    }
+    xcb->atoms_pending = false;
+
+    xcb_change_property(xcb->con, XCB_PROP_MODE_REPLACE, xcb->win, xcb->atoms[ATOM_WM_WINDOW_TYPE], XCB_ATOM_ATOM,
+                        32, 1, &xcb->atoms[ATOM_WM_WINDOW_TYPE_DIALOG]);
+    xcb_change_property(xcb->con, XCB_PROP_MODE_REPLACE, xcb->win, xcb->atoms[ATOM_WM_STATE], XCB_ATOM_ATOM,
+                        32, 1, &xcb->atoms[ATOM_WM_STATE_ABOVE]);
+}
+
+static bool create_window(MediaBoxContext *mbc, XcbBackend *xcb) {
+    xcb_screen_t *screen = xcb->screen;
+    xcb_visualtype_t *visual = find_visual(screen, screen->root_visual);
+    if (visual == NULL)
+        return false;
+
+    int x = (screen->width_in_pixels - WIDTH) / 2;
+    int y = (screen->height_in_pixels - HEIGHT) / 1.2;
+
+    // Same attributes as the Xlib window, values go in the order of their mask bits
+    uint32_t mask = XCB_CW_BACK_PIXMAP | XCB_CW_OVERRIDE_REDIRECT | XCB_CW_EVENT_MASK;
+    uint32_t values[] = { XCB_BACK_PIXMAP_NONE, true, XCB_EVENT_MASK_EXPOSURE | XCB_EVENT_MASK_BUTTON_PRESS };
+    xcb->win = xcb_generate_id(xcb->con);
+    xcb_create_window(xcb->con, XCB_COPY_FROM_PARENT, xcb->win, screen->root, x, y, WIDTH, HEIGHT, 1,
+                      XCB_WINDOW_CLASS_INPUT_OUTPUT, screen->root_visual, mask, values);
+    mbc->win = xcb->win;
+
+    mbc->cairo_surface = cairo_xcb_surface_create(xcb->con, xcb->win, visual, WIDTH, HEIGHT);
+    mbc->window_cairo = cairo_create(mbc->cairo_surface);
+
+    mbc->back_buffer = cairo_surface_create_similar(mbc->cairo_surface, CAIRO_CONTENT_COLOR, WIDTH, HEIGHT);
+    mbc->cairo = cairo_create(mbc->back_buffer);
+    return true;
+}
+
+static bool xcb_box_open(MediaBoxContext *mbc) {
+    int screen_number;
+    xcb_connection_t *con = xcb_connect(NULL, &screen_number);
+    if (xcb_connection_has_error(con)) {
+        xcb_disconnect(con);
+        return false;
+    }
+
+    XcbBackend *xcb = calloc(1, sizeof(XcbBackend));
+    xcb->con = con;
+    xcb_screen_iterator_t screens = xcb_setup_roots_iterator(xcb_get_setup(con));
+    for (int i = 0; i < screen_number && screens.rem; i++)
+        xcb_screen_next(&screens);
+    xcb->screen = screens.data;
+    mbc->screen = screen_number;
+
+    request_atoms(xcb);
+    if (xcb->screen == NULL || !create_window(mbc, xcb)) {
+        xcb_disconnect(con);
+        free(xcb);
+        return false;
+    }
+    xcb_flush(con);
+
+    mbc->backend_data = xcb;
+    return true;
+}
+
+static void xcb_box_close(MediaBoxContext *mbc) {
+    XcbBackend *xcb = mbc->backend_data;
+
+    // cairo keeps its own state on the connection, it has to let go of it before the disconnect
+    cairo_device_t *device = cairo_device_reference(cairo_surface_get_device(mbc->cairo_surface));
+    cairo_destroy(mbc->cairo);
+    cairo_surface_destroy(mbc->back_buffer);
+    cairo_destroy(mbc->window_cairo);
+    cairo_surface_destroy(mbc->cairo_surface);
+    cairo_device_finish(device);
+    cairo_device_destroy(device);
+
+    xcb_destroy_window(xcb->con, xcb->win);
+    xcb_disconnect(xcb->con);
+    free(xcb);
+    mbc->backend_data = NULL;
+}
+
+static void xcb_box_map(MediaBoxContext *mbc) {
+    XcbBackend *xcb = mbc->backend_data;
+    if (xcb->atoms_pending)
+        collect_atoms(mbc, xcb);
+    xcb_map_window(xcb->con, xcb->win);
+    xcb_flush(xcb->con);
+}
+
+static void xcb_box_unmap(MediaBoxContext *mbc) {
+    XcbBackend *xcb = mbc->backend_data;
+    xcb_unmap_window(xcb->con, xcb->win);
+    xcb_flush(xcb->con);
+}
+
+// cairo-xcb batches requests on its own, push them into the connection before flushing it
+static void xcb_box_flush(MediaBoxContext *mbc) {
+    XcbBackend *xcb = mbc->backend_data;
+    cairo_surface_flush(mbc->cairo_surface);
+    xcb_flush(xcb->con);
+}
+
+static void handle_event(MediaBoxContext *mbc, xcb_generic_event_t *event) {
+    switch (event->response_type & ~0x80) {
+    case 0: {
+        xcb_generic_error_t *error = (xcb_generic_error_t *)event;
+        g_warning("X error %d on request %d", error->error_code, error->major_code);
+        break;
+    }
+    case XCB_EXPOSE: {
+        xcb_expose_event_t *expose = (xcb_expose_event_t *)event;
+        media_box_expose(mbc, expose->x, expose->y, expose->width, expose->height, expose->count);
+        break;
+    }
+    case XCB_BUTTON_PRESS: {
+        xcb_button_press_event_t *press = (xcb_button_press_event_t *)event;
+        media_box_click(mbc, press->event_x, press->event_y);
+        break;
+    }
+    }
+}
+
+static gboolean event_source_prepare(GSource *source, gint *timeout) {
+    XcbEventSource *events = (XcbEventSource *)source;
+    XcbBackend *xcb = events->mbc->backend_data;
+
+    *timeout = -1;
+    if (events->queued == NULL)
+        events->queued = xcb_poll_for_queued_event(xcb->con);
+    return events->queued != NULL;
+}
+
+static gboolean event_source_check(GSource *source) {
+    XcbEventSource *events = (XcbEventSource *)source;
+    return events->queued != NULL || (g_source_query_unix_fd(source, events->fd_tag) & (G_IO_IN | G_IO_HUP | G_IO_ERR));
+}
+
+// Never blocks: drains what the socket has, then goes back to the main loop
+static gboolean event_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+    XcbEventSource *events = (XcbEventSource *)source;
+    MediaBoxContext *mbc = events->mbc;
+    XcbBackend *xcb = mbc->backend_data;
+
+    xcb_generic_event_t *event = events->queued;
+    events->queued = NULL;
+    if (event == NULL)
+        event = xcb_poll_for_event(xcb->con);
+    while (event != NULL) {
+        handle_event(mbc, event);
+        free(event);
+        event = xcb_poll_for_event(xcb->con);
+    }
+
+    if (xcb_connection_has_error(xcb->con)) {
+        g_warning("lost the connection to the X server");
+        mbc->event_source = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void event_source_finalize(GSource *source) {
+    XcbEventSource *events = (XcbEventSource *)source;
+    free(events->queued);
+}
+
+static GSourceFuncs event_source_funcs = {
+    .prepare = event_source_prepare,
+    .check = event_source_check,
+    .dispatch = event_source_dispatch,
+    .finalize = event_source_finalize,
+};
+
+static guint xcb_box_watch(MediaBoxContext *mbc) {
+    XcbBackend *xcb = mbc->backend_data;
+
+    GSource *source = g_source_new(&event_source_funcs, sizeof(XcbEventSource));
+    XcbEventSource *events = (XcbEventSource *)source;
+    events->mbc = mbc;
+    events->fd_tag = g_source_add_unix_fd(source, xcb_get_file_descriptor(xcb->con), G_IO_IN | G_IO_HUP | G_IO_ERR);
+    guint id = g_source_attach(source, NULL);
+    g_source_unref(source);
+    return id;
+}
+
+const MediaBoxBackend media_box_xcb_backend = {
+    .name = "xcb",
+    .open = xcb_box_open,
+    .close = xcb_box_close,
+    .map = xcb_box_map,
+    .unmap = xcb_box_unmap,
+    .flush = xcb_box_flush,
+    .watch = xcb_box_watch,
+};
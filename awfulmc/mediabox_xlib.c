@@ -0,0 +1,127 @@
+#include "mediabox.h"
+#include <X11/Xatom.h>
+#include <cairo/cairo-xlib.h>
+#include <glib-unix.h>
+
+static void create_window(MediaBoxContext *mbc) {
+    int x = (DisplayWidth(mbc->display, mbc->screen) - WIDTH) / 2;
+    int y = (DisplayHeight(mbc->display, mbc->screen) - HEIGHT) / 1.2;
+
+    // No background: everything on screen comes from the back buffer, so the server never paints the
+    // window before we copy into it
+    XSetWindowAttributes attrs;
+    attrs.override_redirect = true;
+    attrs.background_pixmap = None;
+    mbc->win = XCreateWindow(
+        mbc->display,
+        RootWindow(mbc->display, mbc->screen),
+        x,
+        y,
+        WIDTH,
+        HEIGHT,
+        1,
+        CopyFromParent,
+        CopyFromParent,
+        CopyFromParent,
+        CWOverrideRedirect | CWBackPixmap,
+        &attrs
+    );
+
+    // One round trip for all of them instead of one per XInternAtom()
+    char *atom_names[ATOM_COUNT] = {
+        [ATOM_WM_STATE] = "_NET_WM_STATE",
+        [ATOM_WM_STATE_ABOVE] = "_NET_WM_STATE_ABOVE",
+        [ATOM_WM_WINDOW_TYPE] = "_NET_WM_WINDOW_TYPE",
+        [ATOM_WM_WINDOW_TYPE_DIALOG] = "_NET_WM_WINDOW_TYPE_DIALOG",
+    };
+    XInternAtoms(mbc->display, atom_names, ATOM_COUNT, false, mbc->atoms);
+    mbc->round_trips++;
+    XChangeProperty(mbc->display, mbc->win, mbc->atoms[ATOM_WM_WINDOW_TYPE], XA_ATOM, 32,
+                    PropModeReplace, (unsigned char *)&mbc->atoms[ATOM_WM_WINDOW_TYPE_DIALOG], 1);
+    XChangeProperty(mbc->display, mbc->win, mbc->atoms[ATOM_WM_STATE], XA_ATOM, 32,
+                    PropModeReplace, (unsigned char *)&mbc->atoms[ATOM_WM_STATE_ABOVE], 1);
+
+    mbc->gc = XCreateGC(mbc->display, mbc->win, 0, NULL);
+    XSelectInput(mbc->display, mbc->win, ExposureMask | ButtonPressMask);
+
+    mbc->cairo_surface = cairo_xlib_surface_create(mbc->display, mbc->win, DefaultVisual(mbc->display, mbc->screen), WIDTH, HEIGHT);
+    mbc->window_cairo = cairo_create(mbc->cairo_surface);
+
+    // All drawing goes to a server side pixmap of the same format, the window only ever gets copies of it
+    mbc->back_buffer = cairo_surface_create_similar(mbc->cairo_surface, CAIRO_CONTENT_COLOR, WIDTH, HEIGHT);
+    mbc->cairo = cairo_create(mbc->back_buffer);
+
+}
+
+static void destroy_window(MediaBoxContext *mbc) {
+    // Remove the window, gc, cairo_surface, back_buffer and both cairo contexts
+    cairo_destroy(mbc->cairo);
+    cairo_surface_destroy(mbc->back_buffer);
+    cairo_destroy(mbc->window_cairo);
+    cairo_surface_destroy(mbc->cairo_surface);
+    XDestroyWindow(mbc->display, mbc->win);
+    XFreeGC(mbc->display, mbc->gc);
+    mbc->win = None;
+}
+
+static bool xlib_open(MediaBoxContext *mbc) {
+    mbc->display = XOpenDisplay(NULL);
+    if (!mbc->display)
+        return false;
+
+    mbc->screen = DefaultScreen(mbc->display);
+    create_window(mbc);
+    return true;
+}
+
+static void xlib_close(MediaBoxContext *mbc) {
+    destroy_window(mbc);
+    XCloseDisplay(mbc->display);
+}
+
+// Mapping makes the server send an Expose, which copies the back buffer over
+static void xlib_map(MediaBoxContext *mbc) {
+    XMapWindow(mbc->display, mbc->win);
+    XFlush(mbc->display);
+}
+
+static void xlib_unmap(MediaBoxContext *mbc) {
+    XUnmapWindow(mbc->display, mbc->win);
+    XFlush(mbc->display);
+}
+
+static void xlib_flush(MediaBoxContext *mbc) {
+    XFlush(mbc->display);
+}
+
+static gboolean xlib_events(gint fd, GIOCondition condition, gpointer user_data) {
+    MediaBoxContext *mbc = user_data;
+
+    while (XPending(mbc->display) > 0) {
+        XEvent event;
+        XNextEvent(mbc->display, &event);
+
+        if (event.type == Expose) {
+            XExposeEvent *expose = &event.xexpose;
+            media_box_expose(mbc, expose->x, expose->y, expose->width, expose->height, expose->count);
+        } else if (event.type == ButtonPress) {
+            media_box_click(mbc, event.xbutton.x, event.xbutton.y);
+        }
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static guint xlib_watch(MediaBoxContext *mbc) {
+    return g_unix_fd_add(ConnectionNumber(mbc->display), G_IO_IN, xlib_events, mbc);
+}
+
+const MediaBoxBackend media_box_xlib_backend = {
+    .name = "xlib",
+    .open = xlib_open,
+    .close = xlib_close,
+    .map = xlib_map,
+    .unmap = xlib_unmap,
+    .flush = xlib_flush,
+    .watch = xlib_watch,
+};
@@ -1,210 +1,465 @@
 #include "player.h"
+#include "utils.h"
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 
+// Everything about one player in a single allocation. Player comes first so a Player * is also the record.
+typedef struct PlayerRecord {
+    Player player;
+    PlayerProperties properties;
+    PlayerMetadata metadata;
+    // Free list link while the record is not in use
+    struct PlayerRecord *next_free;
+} PlayerRecord;
+
+// Records are carved out of slabs of this many and go back on a free list when a player is freed, players
+// that come and go reuse the same memory. Slabs are never returned, the pool only grows to the peak count.
+#define PLAYER_SLAB_SIZE 16
+
+// Players are made and freed on both the bus and the UI thread
+G_LOCK_DEFINE_STATIC(records);
+static PlayerRecord *free_records = NULL;
+
+static PlayerRecord *record_alloc() {
+    G_LOCK(records);
+    if (free_records == NULL) {
+        PlayerRecord *slab = calloc(PLAYER_SLAB_SIZE, sizeof(PlayerRecord));
+        for (int i = PLAYER_SLAB_SIZE - 1; i >= 0; i--) {
+            slab[i].next_free = free_records;
+            free_records = &slab[i];
+        }
+    }
+
+    PlayerRecord *record = free_records;
+    free_records = record->next_free;
+    G_UNLOCK(records);
+    memset(record, 0, sizeof(PlayerRecord));
+    return record;
+}
+
+static void record_release(PlayerRecord *record) {
+    G_LOCK(records);
+    record->next_free = free_records;
+    free_records = record;
+    G_UNLOCK(records);
+}
+
 Player *player_new(const gchar *unique, const gchar *instance) {
     // Unique is owner
-    Player *player = calloc(1, sizeof(Player));
-    gchar **split = g_strsplit(instance, ".", 2);
-    player->name = g_strdup(split[0]);
-    g_strfreev(split);
-    player->instance = g_strdup(instance);
+    PlayerRecord *record = record_alloc();
+    Player *player = &record->player;
+
+    // instance, name and display_name packed into one block: "spotify.instance1\0spotify\0Spotify\0"
+    size_t instance_len = strlen(instance);
+    size_t name_len = strcspn(instance, ".");
+    char *strings = g_malloc(instance_len + 1 + 2 * (name_len + 1));
+    player->instance = memcpy(strings, instance, instance_len + 1);
+    player->name = strings + instance_len + 1;
+    memcpy(player->name, instance, name_len);
+    player->name[name_len] = '\0';
+    player->display_name = title_case(memcpy(player->name + name_len + 1, player->name, name_len + 1));
+
     player->unique = g_strdup(unique);
     player->player_properties = NULL;
+    player->state = PLAYER_STATE_PENDING;
+    player->cancellable = g_cancellable_new();
     return player;
 }
 
-PlayerProperties *properties_new() {
-    PlayerProperties *props = calloc(1, sizeof(PlayerProperties));
+static void properties_init(PlayerProperties *props, PlayerMetadata *md) {
     props->playback_status = PLAYBACK_STOPPED;
     props->loop_status = LOOP_NONE;
     props->rate = 1.0;
-    props->shuffle = false;
-    props->metadata = NULL;
-    props->can_go_next = false;
-    props->can_go_previous = false;
-    props->can_play = false;
-    props->can_pause = false;
-    props->can_control = false;
-    props->can_shuffle = false;
+    props->position = 0;
+    props->position_time = g_get_monotonic_time();
+    props->flags = 0;
+    props->metadata = md;
+}
+
+static void metadata_clear(PlayerMetadata *md) {
+    g_clear_pointer(&md->title, g_ref_string_release);
+    g_clear_pointer(&md->artist, g_ref_string_release);
+    g_clear_pointer(&md->album, g_ref_string_release);
+    g_clear_pointer(&md->art_url, g_ref_string_release);
+}
+
+static void share_string(char **field, char *value) {
+    if (*field == value)
+        return;
+
+    if (*field != NULL)
+        g_ref_string_release(*field);
+    *field = value != NULL ? g_ref_string_acquire(value) : NULL;
+}
+
+void properties_copy(PlayerProperties *dest, const PlayerProperties *src) {
+    PlayerMetadata *md = dest->metadata;
+    share_string(&md->title, src->metadata->title);
+    share_string(&md->artist, src->metadata->artist);
+    share_string(&md->album, src->metadata->album);
+    share_string(&md->art_url, src->metadata->art_url);
+    md->length = src->metadata->length;
+
+    *dest = *src;
+    dest->metadata = md;
+}
+
+void properties_clear(PlayerProperties *props) {
+    metadata_clear(props->metadata);
+}
+
+// Standalone properties for code that keeps state outside a player, players themselves never use these
+PlayerProperties *properties_new() {
+    PlayerProperties *props = calloc(1, sizeof(PlayerProperties));
+    properties_init(props, metadata_new());
     return props;
 }
 
 PlayerMetadata *metadata_new() {
-    PlayerMetadata *md = calloc(1, sizeof(PlayerMetadata));
-    md->title = NULL;
-    md->artist = NULL;
-    md->album = NULL;
-    md->art = NULL;
-    return md;
+    return calloc(1, sizeof(PlayerMetadata));
 }
 
 void metadata_free(PlayerMetadata *md) {
-    if (md->title != NULL) {
-        g_free(md->title);
-    }
-    if (md->artist != NULL) {
-        g_free(md->artist);
-    }
-    if (md->album != NULL) {
-        g_free(md->album);
-    }
+    if (md == NULL)
+        return;
+    metadata_clear(md);
     free(md);
 }
 
 void properties_free(PlayerProperties *props) {
-    if (props->metadata != NULL) {
-        metadata_free(props->metadata);
-    }
-
+    if (props == NULL)
+        return;
+    metadata_free(props->metadata);
     free(props);
 }
 
+// The properties live in the record from the start, they are only pointed at once there is something in them
+static bool player_init_properties(Player *player) {
+    if (player->player_properties != NULL)
+        return false;
+
+    PlayerRecord *record = (PlayerRecord *)player;
+    properties_init(&record->properties, &record->metadata);
+    player->player_properties = &record->properties;
+    return true;
+}
+
+void player_set_properties(Player *player, const PlayerProperties *src) {
+    player_init_properties(player);
+    properties_copy(player->player_properties, src);
+}
+
 void player_free(Player *player) {
     if (player == NULL) {
         return;
     }
-    if (player->player_properties != NULL) {
-        properties_free(player->player_properties);
-    }
+    PlayerRecord *record = (PlayerRecord *)player;
+    // Abort any call still in flight for this player, its callback must not see freed memory
+    g_cancellable_cancel(player->cancellable);
+    g_object_unref(player->cancellable);
+    metadata_clear(&record->metadata);
     if (player->unique != NULL)
         g_free(player->unique);
 
-    g_free(player->name);
     g_free(player->instance);
-    free(player);
+    record_release(record);
 }
 
-bool update_player_properties(Player *player, GVariant *properties) {
-    bool changed = false;
-    // g_variant_iterate_and_print(properties);
+typedef PlayerChanges (*PropertyDecoder)(PlayerProperties *props, GVariant *value, size_t field, PlayerChanges change);
 
-    if (player->player_properties == NULL) {
-        player->player_properties = properties_new();
-        changed = true;
-    }
+typedef struct {
+    const char *key;
+    PropertyDecoder decode;
+    // The PlayerFlag for flag decoders, unused by the others
+    size_t field;
+    PlayerChanges change;
+} PropertyKey;
 
-    PlaybackStatus playback_status;
-    gchar *status = NULL;
-    if (g_variant_lookup(properties, "PlaybackStatus", "&s", &status)) {
-        playback_status = convert_to_playback_status(status);
-        if (playback_status != player->player_properties->playback_status) {
-            player->player_properties->playback_status = playback_status;
-            changed = true;
-        }
-    }
-    status = NULL;
-
-    LoopStatus loop_status;
-    if (g_variant_lookup(properties, "LoopStatus", "&s", &status)) {
-        loop_status = convert_to_loop_status(status);
-        if (loop_status != player->player_properties->loop_status) {
-            player->player_properties->loop_status = loop_status;
-            changed = true;
-        }
-    }
+static int property_key_compare(const void *key, const void *entry) {
+    return strcmp(key, ((const PropertyKey *)entry)->key);
+}
 
-    bool bv;
-    if (g_variant_lookup(properties, "Shuffle", "b", &bv)) {
-        player->player_properties->can_shuffle = true;
-        if (bv != player->player_properties->shuffle) {
-            player->player_properties->shuffle = bv;
-            changed = true;
-        }
-    }
+static const PropertyKey *property_key_find(const PropertyKey *table, size_t n, const char *key) {
+    return bsearch(key, table, n, sizeof(PropertyKey), property_key_compare);
+}
 
-    // START METADATA STUFF
-    if (player->player_properties->metadata == NULL) {
-        player->player_properties->metadata = metadata_new();
+// Metadata strings are interned, equal values share one allocation across players and tracks and an
+// unchanged value costs a hash lookup instead of a copy
+static PlayerChanges update_string(char **field, const char *value, PlayerChanges change) {
+    char *interned = value != NULL ? g_ref_string_new_intern(value) : NULL;
+    if (interned == *field) {
+        if (interned != NULL)
+            g_ref_string_release(interned);
+        return PLAYER_CHANGED_NONE;
     }
 
-    GVariant *metadata = NULL, *artist_list;
-    GVariantIter artist_iter;
-    char *title = NULL, *artist = NULL, *album = NULL;
-    metadata = g_variant_lookup_value(properties, "Metadata", (GVariantType *)"a{sv}");
-    if (metadata != NULL && g_variant_get_size(metadata) > 0) {
-
-        if (g_variant_lookup(metadata, "xesam:title", "&s", &title)) {
-            if (title != NULL) {
-                if (player->player_properties->metadata->title != NULL) {
-                    if (g_strcmp0(title, player->player_properties->metadata->title) != 0) {
-                        changed = true;
-                        g_free(player->player_properties->metadata->title);
-                        player->player_properties->metadata->title = g_strdup(title);
-                    }
-                } else {
-                    player->player_properties->metadata->title = g_strdup(title);
-                }
-            }
-        }
+    if (*field != NULL)
+        g_ref_string_release(*field);
+    *field = interned;
+    return change;
+}
 
-        if (g_variant_lookup(metadata, "xesam:album", "&s", &album)) {
-            if (album != NULL && strlen(album) > 0) {
-                if (player->player_properties->metadata->album != NULL) {
-                    if (g_strcmp0(album, player->player_properties->metadata->album) != 0) {
-                        changed = true;
-                        g_free(player->player_properties->metadata->album);
-                        player->player_properties->metadata->album = g_strdup(album);
-                    }
-                } else {
-                    player->player_properties->metadata->album = g_strdup(album);
-                }
-            }
-        }
+static PlayerChanges decode_flag(PlayerProperties *props, GVariant *value, size_t field, PlayerChanges change) {
+    if (!g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN))
+        return PLAYER_CHANGED_NONE;
 
-        artist_list = g_variant_lookup_value(metadata, "xesam:artist", (GVariantType *)"as");
-        if (artist_list != NULL) {
-            g_variant_iter_init(&artist_iter, artist_list);
-            g_variant_iter_next(&artist_iter, "&s", &artist);
-            if (player->player_properties->metadata->artist != NULL) {
-                if (g_strcmp0(artist, player->player_properties->metadata->artist) != 0) {
-                    changed = true;
-                    g_free(player->player_properties->metadata->artist);
-                    player->player_properties->metadata->artist = g_strdup(artist);
-                }
-            } else {
-                player->player_properties->metadata->artist = g_strdup(artist);
-            }
-
-            g_variant_unref(artist_list);
-        }
-        g_variant_unref(metadata);
-    }
-    // END METADATA STUFF
+    PlayerFlags flags = g_variant_get_boolean(value) ? props->flags | field : props->flags & ~field;
+    if (flags == props->flags)
+        return PLAYER_CHANGED_NONE;
 
-    if (g_variant_lookup(properties, "CanGoNext", "b", &bv)) {
-        if (bv != player->player_properties->can_go_next) {
-            player->player_properties->can_go_next = bv;
-            changed = true;
-        }
-    }
-    if (g_variant_lookup(properties, "CanGoPrevious", "b", &bv)) {
-        if (bv != player->player_properties->can_go_previous) {
-            player->player_properties->can_go_previous = bv;
-            changed = true;
-        }
+    props->flags = flags;
+    return change;
+}
+
+static PlayerChanges decode_shuffle(PlayerProperties *props, GVariant *value, size_t field, PlayerChanges change) {
+    if (!g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN))
+        return PLAYER_CHANGED_NONE;
+
+    // Players that do not support shuffling leave the property out entirely
+    props->flags |= PLAYER_FLAG_CAN_SHUFFLE;
+    return decode_flag(props, value, field, change);
+}
+
+gint64 player_position(const PlayerProperties *props, gint64 now) {
+    gint64 position = props->position;
+    if (props->playback_status == PLAYBACK_PLAYING)
+        position += (gint64)((now - props->position_time) * props->rate);
+
+    if (position < 0)
+        return 0;
+    if (props->metadata != NULL && props->metadata->length > 0 && position > props->metadata->length)
+        return props->metadata->length;
+    return position;
+}
+
+// Folds the time played so far into the position, needed before anything the extrapolation depends on changes
+static void anchor_position(PlayerProperties *props) {
+    gint64 now = g_get_monotonic_time();
+    props->position = player_position(props, now);
+    props->position_time = now;
+}
+
+PlayerChanges player_seeked(Player *player, gint64 position) {
+    if (player->player_properties == NULL)
+        return PLAYER_CHANGED_NONE;
+
+    player->player_properties->position = position;
+    player->player_properties->position_time = g_get_monotonic_time();
+    return PLAYER_CHANGED_POSITION;
+}
+
+static PlayerChanges decode_playback_status(PlayerProperties *props, GVariant *value, size_t field, PlayerChanges change) {
+    if (!g_variant_is_of_type(value, G_VARIANT_TYPE_STRING))
+        return PLAYER_CHANGED_NONE;
+
+    PlaybackStatus playback_status = convert_to_playback_status(g_variant_get_string(value, NULL));
+    if (playback_status == props->playback_status)
+        return PLAYER_CHANGED_NONE;
+
+    anchor_position(props);
+    props->playback_status = playback_status;
+    return change;
+}
+
+static PlayerChanges decode_rate(PlayerProperties *props, GVariant *value, size_t field, PlayerChanges change) {
+    if (!g_variant_is_of_type(value, G_VARIANT_TYPE_DOUBLE))
+        return PLAYER_CHANGED_NONE;
+
+    double rate = g_variant_get_double(value);
+    if (rate == props->rate)
+        return PLAYER_CHANGED_NONE;
+
+    anchor_position(props);
+    props->rate = rate;
+    return change;
+}
+
+static PlayerChanges decode_position(PlayerProperties *props, GVariant *value, size_t field, PlayerChanges change) {
+    if (!g_variant_is_of_type(value, G_VARIANT_TYPE_INT64))
+        return PLAYER_CHANGED_NONE;
+
+    // Position is only ever read (GetAll), never signalled, so the reply is as fresh as it gets
+    props->position = g_variant_get_int64(value);
+    props->position_time = g_get_monotonic_time();
+    return change;
+}
+
+static PlayerChanges decode_loop_status(PlayerProperties *props, GVariant *value, size_t field, PlayerChanges change) {
+    if (!g_variant_is_of_type(value, G_VARIANT_TYPE_STRING))
+        return PLAYER_CHANGED_NONE;
+
+    LoopStatus loop_status = convert_to_loop_status(g_variant_get_string(value, NULL));
+    if (loop_status == props->loop_status)
+        return PLAYER_CHANGED_NONE;
+
+    props->loop_status = loop_status;
+    return change;
+}
+
+// Metadata decoders are called with a NULL value to clear a key the new metadata does not have
+static PlayerChanges decode_metadata_string(PlayerMetadata *md, GVariant *value, size_t offset, PlayerChanges change) {
+    if (value == NULL)
+        return update_string((char **)((char *)md + offset), NULL, change);
+    if (!g_variant_is_of_type(value, G_VARIANT_TYPE_STRING))
+        return PLAYER_CHANGED_NONE;
+
+    const char *str = g_variant_get_string(value, NULL);
+    return update_string((char **)((char *)md + offset), str[0] != '\0' ? str : NULL, change);
+}
+
+static PlayerChanges decode_metadata_first_string(PlayerMetadata *md, GVariant *value, size_t offset, PlayerChanges change) {
+    if (value == NULL)
+        return update_string((char **)((char *)md + offset), NULL, change);
+    if (!g_variant_is_of_type(value, G_VARIANT_TYPE_STRING_ARRAY))
+        return PLAYER_CHANGED_NONE;
+
+    // Only the first artist is shown
+    const char *str = NULL;
+    if (g_variant_n_children(value) > 0) {
+        GVariant *first = g_variant_get_child_value(value, 0);
+        str = g_variant_get_string(first, NULL);
+        g_variant_unref(first);
     }
-    if (g_variant_lookup(properties, "CanPlay", "b", &bv)) {
-        if (bv != player->player_properties->can_play) {
-            player->player_properties->can_play = bv;
-            changed = true;
+    return update_string((char **)((char *)md + offset), str != NULL && str[0] != '\0' ? str : NULL, change);
+}
+
+static PlayerChanges decode_metadata_length(PlayerMetadata *md, GVariant *value, size_t offset, PlayerChanges change) {
+    // The spec says x, but plenty of players send whatever integer type their bindings picked
+    gint64 length;
+    if (value == NULL)
+        length = 0;
+    else if (g_variant_is_of_type(value, G_VARIANT_TYPE_INT64))
+        length = g_variant_get_int64(value);
+    else if (g_variant_is_of_type(value, G_VARIANT_TYPE_UINT64))
+        length = (gint64)g_variant_get_uint64(value);
+    else if (g_variant_is_of_type(value, G_VARIANT_TYPE_INT32))
+        length = g_variant_get_int32(value);
+    else if (g_variant_is_of_type(value, G_VARIANT_TYPE_UINT32))
+        length = g_variant_get_uint32(value);
+    else
+        return PLAYER_CHANGED_NONE;
+
+    gint64 *field = (gint64 *)((char *)md + offset);
+    if (*field == length)
+        return PLAYER_CHANGED_NONE;
+
+    *field = length;
+    return change;
+}
+
+typedef PlayerChanges (*MetadataDecoder)(PlayerMetadata *md, GVariant *value, size_t offset, PlayerChanges change);
+
+typedef struct {
+    const char *key;
+    MetadataDecoder decode;
+    size_t offset;
+    PlayerChanges change;
+} MetadataKey;
+
+// Sorted by key for bsearch(), check_key_order() enforces it
+static const MetadataKey metadata_keys[] = {
+    { "mpris:artUrl", decode_metadata_string,       offsetof(PlayerMetadata, art_url), PLAYER_CHANGED_ART_URL },
+    { "mpris:length", decode_metadata_length,       offsetof(PlayerMetadata, length), PLAYER_CHANGED_LENGTH },
+    { "xesam:album",  decode_metadata_string,       offsetof(PlayerMetadata, album),  PLAYER_CHANGED_ALBUM },
+    { "xesam:artist", decode_metadata_first_string, offsetof(PlayerMetadata, artist), PLAYER_CHANGED_ARTIST },
+    { "xesam:title",  decode_metadata_string,       offsetof(PlayerMetadata, title),  PLAYER_CHANGED_TITLE },
+};
+
+static int metadata_key_compare(const void *key, const void *entry) {
+    return strcmp(key, ((const MetadataKey *)entry)->key);
+}
+
+static PlayerChanges decode_metadata(PlayerProperties *props, GVariant *value, size_t field, PlayerChanges change) {
+    if (!g_variant_is_of_type(value, G_VARIANT_TYPE_VARDICT))
+        return PLAYER_CHANGED_NONE;
+
+    PlayerMetadata *md = props->metadata;
+    PlayerChanges changes = PLAYER_CHANGED_NONE;
+    PlayerChanges seen = PLAYER_CHANGED_NONE;
+    GVariantIter iter;
+    const char *key;
+    GVariant *item;
+
+    g_variant_iter_init(&iter, value);
+    while (g_variant_iter_next(&iter, "{&sv}", &key, &item)) {
+        const MetadataKey *entry = bsearch(key, metadata_keys, G_N_ELEMENTS(metadata_keys), sizeof(MetadataKey), metadata_key_compare);
+        if (entry != NULL) {
+            changes |= entry->decode(md, item, entry->offset, entry->change);
+            seen |= entry->change;
         }
+        g_variant_unref(item);
     }
-    if (g_variant_lookup(properties, "CanPause", "b", &bv)) {
-        if (bv != player->player_properties->can_pause) {
-            player->player_properties->can_pause = bv;
-            changed = true;
+
+    // Metadata is always sent whole, anything the new track does not have is cleared
+    for (size_t i = 0; i < G_N_ELEMENTS(metadata_keys); i++) {
+        if (!(seen & metadata_keys[i].change)) {
+            changes |= metadata_keys[i].decode(md, NULL, metadata_keys[i].offset, metadata_keys[i].change);
         }
     }
-    if (g_variant_lookup(properties, "CanControl", "b", &bv)) {
-        if (bv != player->player_properties->can_control) {
-            player->player_properties->can_control = bv;
-            changed = true;
+
+    return changes;
+}
+
+// Sorted by key for bsearch(), check_key_order() enforces it
+static const PropertyKey property_keys[] = {
+    { "CanControl",     decode_flag,            PLAYER_FLAG_CAN_CONTROL,                     PLAYER_CHANGED_CAN_CONTROL },
+    { "CanGoNext",      decode_flag,            PLAYER_FLAG_CAN_GO_NEXT,                     PLAYER_CHANGED_CAN_GO_NEXT },
+    { "CanGoPrevious",  decode_flag,            PLAYER_FLAG_CAN_GO_PREVIOUS,                 PLAYER_CHANGED_CAN_GO_PREVIOUS },
+    { "CanPause",       decode_flag,            PLAYER_FLAG_CAN_PAUSE,                       PLAYER_CHANGED_CAN_PAUSE },
+    { "CanPlay",        decode_flag,            PLAYER_FLAG_CAN_PLAY,                        PLAYER_CHANGED_CAN_PLAY },
+    { "LoopStatus",     decode_loop_status,     0,                                           PLAYER_CHANGED_LOOP_STATUS },
+    { "Metadata",       decode_metadata,        0,                                           PLAYER_CHANGED_NONE },
+    { "PlaybackStatus", decode_playback_status, 0,                                           PLAYER_CHANGED_PLAYBACK_STATUS },
+    { "Position",       decode_position,        0,                                           PLAYER_CHANGED_POSITION },
+    { "Rate",           decode_rate,            0,                                           PLAYER_CHANGED_RATE },
+    { "Shuffle",        decode_shuffle,         PLAYER_FLAG_SHUFFLE,                         PLAYER_CHANGED_SHUFFLE },
+};
+
+// A key added out of order would not fail to build, bsearch() would just miss it and others around it
+static void check_key_order() {
+    static gsize checked = 0;
+    if (!g_once_init_enter(&checked))
+        return;
+
+    for (size_t i = 1; i < G_N_ELEMENTS(property_keys); i++)
+        g_assert(strcmp(property_keys[i - 1].key, property_keys[i].key) < 0);
+    for (size_t i = 1; i < G_N_ELEMENTS(metadata_keys); i++)
+        g_assert(strcmp(metadata_keys[i - 1].key, metadata_keys[i].key) < 0);
+    g_once_init_leave(&checked, 1);
+}
+
+PlayerChanges update_player_properties(Player *player, GVariant *properties) {
+    check_key_order();
+    PlayerChanges changes = PLAYER_CHANGED_NONE;
+    // g_variant_iterate_and_print(properties);
+
+    bool fresh = player_init_properties(player);
+    if (fresh)
+        changes = PLAYER_CHANGED_ALL;
+
+    // One pass over the dictionary, each key is dispatched straight to its decoder
+    GVariantIter iter;
+    const char *key;
+    GVariant *value;
+    g_variant_iter_init(&iter, properties);
+    while (g_variant_iter_next(&iter, "{&sv}", &key, &value)) {
+        const PropertyKey *entry = property_key_find(property_keys, G_N_ELEMENTS(property_keys), key);
+        if (entry != NULL) {
+            changes |= entry->decode(player->player_properties, value, entry->field, entry->change);
         }
+        g_variant_unref(value);
     }
 
-    return changed;
+    // Not every player emits Seeked when the track changes, a new track that came without a Position
+    // starts from the beginning
+    if (!fresh && (changes & PLAYER_CHANGED_TITLE) && !(changes & PLAYER_CHANGED_POSITION))
+        changes |= player_seeked(player, 0);
+
+    return changes;
 }
 
 void print_player(Player *player) {
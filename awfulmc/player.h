@@ -5,41 +5,116 @@
 #include <stdint.h>
 #include "amc_enums.h"
 
+// Strings are interned GRefStrings (g_ref_string_new_intern()), two fields hold the same text exactly when
+// the pointers are equal. Release them with g_ref_string_release(), never g_free().
 typedef struct {
     char *title;
     char *artist;
     char *album;
-    uint8_t *art;
+    char *art_url;
+    // Track length in microseconds, 0 when unknown
+    gint64 length;
 } PlayerMetadata;
 
+// Boolean properties, packed into PlayerProperties.flags
+typedef enum {
+    PLAYER_FLAG_SHUFFLE = 1 << 0,
+    PLAYER_FLAG_CAN_GO_NEXT = 1 << 1,
+    PLAYER_FLAG_CAN_GO_PREVIOUS = 1 << 2,
+    PLAYER_FLAG_CAN_PLAY = 1 << 3,
+    PLAYER_FLAG_CAN_PAUSE = 1 << 4,
+    PLAYER_FLAG_CAN_CONTROL = 1 << 5,
+    // Set once the player has sent Shuffle at all, players that cannot shuffle leave it out
+    PLAYER_FLAG_CAN_SHUFFLE = 1 << 6,
+} PlayerFlag;
+
+// Bitmask of PlayerFlag values
+typedef guint8 PlayerFlags;
+
 typedef struct {
+    PlayerMetadata *metadata;
+    double rate;
+    // Position in microseconds as of position_time (monotonic), see player_position()
+    gint64 position;
+    gint64 position_time;
     PlaybackStatus playback_status;
     LoopStatus loop_status;
-    double rate;
-    bool shuffle;
-    bool can_go_next;
-    bool can_go_previous;
-    bool can_play;
-    bool can_pause;
-    bool can_control;
-    bool can_shuffle;
-    PlayerMetadata *metadata;
+    PlayerFlags flags;
 } PlayerProperties;
 
+static inline bool player_has_flag(const PlayerProperties *props, PlayerFlag flag) {
+    return (props->flags & flag) != 0;
+}
+
+typedef enum {
+    PLAYER_STATE_PENDING,
+    PLAYER_STATE_FETCHING,
+    PLAYER_STATE_LIVE,
+} PlayerState;
+
+typedef enum {
+    PLAYER_CHANGED_NONE = 0,
+    PLAYER_CHANGED_PLAYBACK_STATUS = 1 << 0,
+    PLAYER_CHANGED_LOOP_STATUS = 1 << 1,
+    PLAYER_CHANGED_SHUFFLE = 1 << 2,
+    PLAYER_CHANGED_TITLE = 1 << 3,
+    PLAYER_CHANGED_ARTIST = 1 << 4,
+    PLAYER_CHANGED_ALBUM = 1 << 5,
+    PLAYER_CHANGED_CAN_GO_NEXT = 1 << 6,
+    PLAYER_CHANGED_CAN_GO_PREVIOUS = 1 << 7,
+    PLAYER_CHANGED_CAN_PLAY = 1 << 8,
+    PLAYER_CHANGED_CAN_PAUSE = 1 << 9,
+    PLAYER_CHANGED_CAN_CONTROL = 1 << 10,
+    PLAYER_CHANGED_ART_URL = 1 << 11,
+    PLAYER_CHANGED_RATE = 1 << 12,
+    PLAYER_CHANGED_POSITION = 1 << 13,
+    PLAYER_CHANGED_LENGTH = 1 << 14,
+    PLAYER_CHANGED_ALL = (1 << 15) - 1,
+} PlayerChange;
+
+#define PLAYER_CHANGED_METADATA (PLAYER_CHANGED_TITLE | PLAYER_CHANGED_ARTIST | PLAYER_CHANGED_ALBUM | PLAYER_CHANGED_ART_URL | PLAYER_CHANGED_LENGTH)
+#define PLAYER_CHANGED_PROGRESS (PLAYER_CHANGED_PLAYBACK_STATUS | PLAYER_CHANGED_RATE | PLAYER_CHANGED_POSITION | PLAYER_CHANGED_LENGTH)
+
+// Bitmask of PlayerChange values
+typedef guint32 PlayerChanges;
+
+// Players are allocated as one record together with their properties and metadata, see player.c.
+// player_properties stays NULL until the first update_player_properties(), after that it points into
+// the same record.
 typedef struct {
     char *unique;
+    // name, display_name and instance share one allocation, owned by instance
     char *name;
+    // name as shown in the media box, worked out once in player_new()
+    char *display_name;
     char *instance;
     PlayerProperties *player_properties;
+    PlayerState state;
+    GCancellable *cancellable;
+    GList live_link;
+    // Among the players sharing this unique name, see registry.c
+    GList unique_link;
+    // Unlinked until the player is first seen starting to play, see player_registry_touch_playing()
+    GList mru_link;
 } Player;
 
 Player *player_new(const gchar *unique, const gchar *instance);
+void player_free(Player *player);
+// dest->metadata must point at its own PlayerMetadata, strings end up shared with src rather than copied
+void properties_copy(PlayerProperties *dest, const PlayerProperties *src);
+// Drops the metadata strings of a copy made with properties_copy()
+void properties_clear(PlayerProperties *props);
+// Heap allocated properties with their own metadata, for state kept outside a player. Free with
+// properties_free(), which also frees the metadata.
 PlayerProperties *properties_new();
 PlayerMetadata *metadata_new();
 void metadata_free(PlayerMetadata *md);
 void properties_free(PlayerProperties *props);
-void player_free(Player *player);
-bool update_player_properties(Player *player, GVariant *properties);
+// Replaces the whole state of a player that is fed from copies instead of update_player_properties()
+void player_set_properties(Player *player, const PlayerProperties *src);
+PlayerChanges update_player_properties(Player *player, GVariant *properties);
+PlayerChanges player_seeked(Player *player, gint64 position);
+gint64 player_position(const PlayerProperties *props, gint64 now);
 void print_player(Player *player);
 gint player_compare(gconstpointer a, gconstpointer b);
 #endif
@@ -0,0 +1,96 @@
+#include "amcreader.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+int amc_reader_open(AmcReader *reader) {
+    return amc_reader_open_name(reader, AMC_SHM_NAME);
+}
+
+int amc_reader_open_name(AmcReader *reader, const char *name) {
+    reader->state = NULL;
+
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(AmcShmState)) {
+        close(fd);
+        errno = EPROTO;
+        return -1;
+    }
+
+    const AmcShmState *state = mmap(NULL, sizeof(AmcShmState), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (state == MAP_FAILED)
+        return -1;
+
+    if (state->magic != AMC_SHM_MAGIC || state->version != AMC_SHM_VERSION || state->size != sizeof(AmcShmState)) {
+        munmap((void *)state, sizeof(AmcShmState));
+        errno = EPROTO;
+        return -1;
+    }
+
+    reader->state = state;
+    return 0;
+}
+
+void amc_reader_close(AmcReader *reader) {
+    if (reader->state != NULL) {
+        munmap((void *)reader->state, sizeof(AmcShmState));
+        reader->state = NULL;
+    }
+}
+
+bool amc_reader_changed(const AmcReader *reader, uint32_t *seen) {
+    uint32_t sequence = __atomic_load_n(&reader->state->sequence, __ATOMIC_ACQUIRE) & ~1u;
+    if (sequence == *seen)
+        return false;
+
+    *seen = sequence;
+    return true;
+}
+
+uint32_t amc_reader_snapshot(const AmcReader *reader, AmcShmState *out) {
+    const AmcShmState *state = reader->state;
+    for (unsigned int attempt = 0;; attempt++) {
+        uint32_t before = __atomic_load_n(&state->sequence, __ATOMIC_ACQUIRE);
+        if (!(before & 1)) {
+            memcpy(out, state, sizeof(AmcShmState));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&state->sequence, __ATOMIC_RELAXED) == before)
+                break;
+        }
+        // The writer holds the lock for a few microseconds at most, only back off if it got descheduled
+        if (attempt > 64)
+            sched_yield();
+    }
+
+    out->sequence &= ~1u;
+    if (out->player_count > AMC_SHM_MAX_PLAYERS)
+        out->player_count = AMC_SHM_MAX_PLAYERS;
+    return out->player_count;
+}
+
+int64_t amc_player_position(const AmcShmPlayer *player) {
+    int64_t position = player->position;
+    if (player->playback_status == AMC_SHM_PLAYBACK_PLAYING) {
+        // Same clock as g_get_monotonic_time(), served from the vDSO
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        int64_t now = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+        position += (int64_t)((now - player->position_time) * player->rate);
+    }
+
+    if (position < 0)
+        return 0;
+    if (player->length > 0 && position > player->length)
+        return player->length;
+    return position;
+}
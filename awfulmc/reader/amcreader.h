@@ -0,0 +1,26 @@
+#ifndef __AMCREADER_H__
+#define __AMCREADER_H__
+
+// Reads the player state awfulmc publishes in /dev/shm. After amc_reader_open() no call makes a syscall
+// or takes a lock, so it is fine to poll this every frame. Depends on nothing but libc.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "shm_layout.h"
+
+typedef struct {
+    const AmcShmState *state;
+} AmcReader;
+
+// Returns 0, or -1 with errno set when the daemon never ran or the layout does not match
+int amc_reader_open(AmcReader *reader);
+// Same for a daemon started with AWFULMC_SHM set, name is that value
+int amc_reader_open_name(AmcReader *reader, const char *name);
+void amc_reader_close(AmcReader *reader);
+// Cheap check for whether anything was published since *seen, updates *seen. Start with *seen = 0.
+bool amc_reader_changed(const AmcReader *reader, uint32_t *seen);
+// Copies a consistent snapshot into out, returns the number of players in it
+uint32_t amc_reader_snapshot(const AmcReader *reader, AmcShmState *out);
+// Current playback position of a snapshotted player in microseconds, extrapolated the way the daemon does
+int64_t amc_player_position(const AmcShmPlayer *player);
+#endif
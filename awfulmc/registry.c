@@ -0,0 +1,144 @@
+#include "registry.h"
+
+static void unique_entry_free(gpointer data) {
+    UniqueEntry *entry = data;
+    g_free(entry->unique);
+    free(entry);
+}
+
+PlayerRegistry *player_registry_new() {
+    PlayerRegistry *reg = calloc(1, sizeof(PlayerRegistry));
+    // Unique name keys belong to their entry, instance keys are borrowed from the players, which outlive
+    // their entries
+    reg->by_unique = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, unique_entry_free);
+    reg->by_instance = g_hash_table_new(g_str_hash, g_str_equal);
+    g_queue_init(&reg->live);
+    g_queue_init(&reg->mru);
+    return reg;
+}
+
+void player_registry_free(PlayerRegistry *reg) {
+    GHashTableIter iter;
+    gpointer player;
+
+    g_hash_table_iter_init(&iter, reg->by_instance);
+    while (g_hash_table_iter_next(&iter, NULL, &player)) {
+        player_free(player);
+    }
+    g_hash_table_destroy(reg->by_unique);
+    g_hash_table_destroy(reg->by_instance);
+    free(reg);
+}
+
+static void index_unique(PlayerRegistry *reg, Player *player) {
+    if (player->unique == NULL)
+        return;
+
+    UniqueEntry *entry = g_hash_table_lookup(reg->by_unique, player->unique);
+    if (entry == NULL) {
+        entry = calloc(1, sizeof(UniqueEntry));
+        entry->unique = g_strdup(player->unique);
+        g_queue_init(&entry->players);
+        g_hash_table_insert(reg->by_unique, entry->unique, entry);
+    }
+    player->unique_link.data = player;
+    g_queue_push_tail_link(&entry->players, &player->unique_link);
+}
+
+static void unindex_unique(PlayerRegistry *reg, Player *player) {
+    if (player->unique_link.data == NULL)
+        return;
+
+    // The next name of the same connection, if any, moves up to the head and answers for the sender
+    UniqueEntry *entry = g_hash_table_lookup(reg->by_unique, player->unique);
+    g_queue_unlink(&entry->players, &player->unique_link);
+    player->unique_link.data = NULL;
+    if (g_queue_is_empty(&entry->players))
+        g_hash_table_remove(reg->by_unique, player->unique);
+}
+
+void player_registry_add(PlayerRegistry *reg, Player *player) {
+    g_hash_table_insert(reg->by_instance, player->instance, player);
+    index_unique(reg, player);
+}
+
+void player_registry_set_live(PlayerRegistry *reg, Player *player) {
+    if (player->live_link.data != NULL)
+        return;
+
+    player->live_link.data = player;
+    g_queue_push_tail_link(&reg->live, &player->live_link);
+}
+
+void player_registry_remove(PlayerRegistry *reg, Player *player) {
+    if (player->live_link.data != NULL) {
+        g_queue_unlink(&reg->live, &player->live_link);
+        player->live_link.data = NULL;
+    }
+    if (player->mru_link.data != NULL) {
+        g_queue_unlink(&reg->mru, &player->mru_link);
+        player->mru_link.data = NULL;
+    }
+    g_hash_table_remove(reg->by_instance, player->instance);
+    unindex_unique(reg, player);
+}
+
+void player_registry_set_unique(PlayerRegistry *reg, Player *player, const char *unique) {
+    unindex_unique(reg, player);
+    g_free(player->unique);
+    player->unique = g_strdup(unique);
+    index_unique(reg, player);
+}
+
+UniqueEntry *player_registry_unique_entry(PlayerRegistry *reg, const char *unique) {
+    return g_hash_table_lookup(reg->by_unique, unique);
+}
+
+Player *player_registry_find_unique(PlayerRegistry *reg, const char *unique) {
+    UniqueEntry *entry = g_hash_table_lookup(reg->by_unique, unique);
+    return entry != NULL ? g_queue_peek_head(&entry->players) : NULL;
+}
+
+Player *player_registry_find_instance(PlayerRegistry *reg, const char *instance) {
+    return g_hash_table_lookup(reg->by_instance, instance);
+}
+
+guint player_registry_live_count(PlayerRegistry *reg) {
+    return reg->live.length;
+}
+
+Player *player_registry_first(PlayerRegistry *reg) {
+    return g_queue_peek_head(&reg->live);
+}
+
+Player *player_registry_next(PlayerRegistry *reg, Player *player) {
+    if (player == NULL || player->live_link.data == NULL)
+        return player_registry_first(reg);
+
+    GList *next = player->live_link.next != NULL ? player->live_link.next : reg->live.head;
+    return next->data;
+}
+
+Player *player_registry_prev(PlayerRegistry *reg, Player *player) {
+    if (player == NULL || player->live_link.data == NULL)
+        return player_registry_first(reg);
+
+    GList *prev = player->live_link.prev != NULL ? player->live_link.prev : reg->live.tail;
+    return prev->data;
+}
+
+// Called on every transition to PLAYBACK_PLAYING
+void player_registry_touch_playing(PlayerRegistry *reg, Player *player) {
+    if (player->mru_link.data != NULL)
+        g_queue_unlink(&reg->mru, &player->mru_link);
+
+    player->mru_link.data = player;
+    g_queue_push_head_link(&reg->mru, &player->mru_link);
+}
+
+// Where a command goes when nothing picks a player: the one that most recently started playing, or the
+// first live one if none has yet
+Player *player_registry_active(PlayerRegistry *reg) {
+    Player *player = g_queue_peek_head(&reg->mru);
+    return player != NULL ? player : player_registry_first(reg);
+}
@@ -0,0 +1,45 @@
+#ifndef __REGISTRY_H__
+#define __REGISTRY_H__
+
+#include "glib.h"
+#include "player.h"
+
+// A single connection may own several MPRIS names. They are queued in registration order through the
+// link embedded in each player, the head answers for the sender and handing over is just an unlink. The
+// entry goes away with its last player.
+typedef struct {
+    char *unique;
+    GQueue players;
+    // Signal matches scoped to this sender, made once however many names it owns, see bus.c
+    guint properties_subscription;
+    guint seeked_subscription;
+} UniqueEntry;
+
+// Indexes every known player by instance, and by unique bus name through a UniqueEntry listing every
+// player the connection owns a name for. Live players are additionally kept in
+// carousel order through the GList node embedded in each Player, so removal never has to search. mru
+// works the same way and holds the players that started playing, most recent first.
+typedef struct {
+    // UniqueEntry by unique name
+    GHashTable *by_unique;
+    GHashTable *by_instance;
+    GQueue live;
+    GQueue mru;
+} PlayerRegistry;
+
+PlayerRegistry *player_registry_new();
+void player_registry_free(PlayerRegistry *reg);
+void player_registry_add(PlayerRegistry *reg, Player *player);
+void player_registry_set_live(PlayerRegistry *reg, Player *player);
+void player_registry_remove(PlayerRegistry *reg, Player *player);
+void player_registry_set_unique(PlayerRegistry *reg, Player *player, const char *unique);
+UniqueEntry *player_registry_unique_entry(PlayerRegistry *reg, const char *unique);
+Player *player_registry_find_unique(PlayerRegistry *reg, const char *unique);
+Player *player_registry_find_instance(PlayerRegistry *reg, const char *instance);
+guint player_registry_live_count(PlayerRegistry *reg);
+Player *player_registry_first(PlayerRegistry *reg);
+Player *player_registry_next(PlayerRegistry *reg, Player *player);
+Player *player_registry_prev(PlayerRegistry *reg, Player *player);
+void player_registry_touch_playing(PlayerRegistry *reg, Player *player);
+Player *player_registry_active(PlayerRegistry *reg);
+#endif
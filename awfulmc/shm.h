@@ -0,0 +1,17 @@
+#ifndef __SHM_H__
+#define __SHM_H__
+
+#include "registry.h"
+#include "shm_layout.h"
+
+// Writer side of the /dev/shm snapshot. The object is kept across restarts so readers that mapped it
+// stay valid, on exit it is only emptied.
+typedef struct {
+    int fd;
+    AmcShmState *state;
+} ShmPublisher;
+
+ShmPublisher *shm_publisher_new(const char *name);
+void shm_publisher_free(ShmPublisher *shm);
+void shm_publish(ShmPublisher *shm, PlayerRegistry *players);
+#endif
@@ -0,0 +1,68 @@
+#ifndef __SHM_LAYOUT_H__
+#define __SHM_LAYOUT_H__
+
+// Layout of the state snapshot published in /dev/shm, shared by the daemon and the reader library.
+// Only fixed size types are used so readers built separately agree on it; bump AMC_SHM_VERSION on any change.
+
+#include <stdint.h>
+
+#define AMC_SHM_NAME "/awfulmc"
+#define AMC_SHM_MAGIC 0x53434d41u /* "AMCS" */
+#define AMC_SHM_VERSION 2
+#define AMC_SHM_MAX_PLAYERS 16
+#define AMC_SHM_NAME_LEN 64
+#define AMC_SHM_TEXT_LEN 256
+#define AMC_SHM_URL_LEN 512
+
+// Same values as PlaybackStatus and LoopStatus
+enum {
+    AMC_SHM_PLAYBACK_PLAYING = 0,
+    AMC_SHM_PLAYBACK_PAUSED = 1,
+    AMC_SHM_PLAYBACK_STOPPED = 2,
+    AMC_SHM_PLAYBACK_DISABLED = 3,
+};
+
+enum {
+    AMC_SHM_LOOP_NONE = 0,
+    AMC_SHM_LOOP_TRACK = 1,
+    AMC_SHM_LOOP_PLAYLIST = 2,
+    AMC_SHM_LOOP_DISABLED = -1,
+};
+
+// Strings are NUL terminated and truncated to fit
+typedef struct {
+    char instance[AMC_SHM_NAME_LEN];
+    char name[AMC_SHM_NAME_LEN];
+    int32_t playback_status;
+    int32_t loop_status;
+    double rate;
+    uint8_t shuffle;
+    uint8_t can_go_next;
+    uint8_t can_go_previous;
+    uint8_t can_play;
+    uint8_t can_pause;
+    uint8_t can_control;
+    uint8_t can_shuffle;
+    uint8_t reserved;
+    // Microseconds. position is as of position_time on CLOCK_MONOTONIC, while playing it advances by rate.
+    int64_t length;
+    int64_t position;
+    int64_t position_time;
+    char title[AMC_SHM_TEXT_LEN];
+    char artist[AMC_SHM_TEXT_LEN];
+    char album[AMC_SHM_TEXT_LEN];
+    char art_url[AMC_SHM_URL_LEN];
+} AmcShmPlayer;
+
+// sequence is a seqlock: the writer makes it odd before touching anything below it and even again once done.
+// A reader copies the state between two loads of an even, unchanged sequence. Players are in carousel order.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t sequence;
+    uint32_t writer_pid;
+    uint32_t player_count;
+    AmcShmPlayer players[AMC_SHM_MAX_PLAYERS];
+} AmcShmState;
+#endif
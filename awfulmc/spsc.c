@@ -0,0 +1,112 @@
+#include "spsc.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+static void fd_signal(int fd) {
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) == -1)
+        perror("eventfd write failed");
+}
+
+static void fd_ack(int fd) {
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+        perror("eventfd read failed");
+}
+
+SpscRing *spsc_ring_new() {
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd == -1) {
+        perror("eventfd creation failed");
+        return NULL;
+    }
+
+    int space_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (space_fd == -1) {
+        perror("eventfd creation failed");
+        close(fd);
+        return NULL;
+    }
+
+    SpscRing *ring = calloc(1, sizeof(SpscRing));
+    ring->fd = fd;
+    ring->space_fd = space_fd;
+    // The consumer starts out waiting
+    ring->sleeping = 1;
+    return ring;
+}
+
+void spsc_ring_free(SpscRing *ring) {
+    if (ring == NULL)
+        return;
+
+    close(ring->fd);
+    close(ring->space_fd);
+    free(ring);
+}
+
+bool spsc_ring_push(SpscRing *ring, gpointer item) {
+    guint head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == SPSC_RING_SIZE)
+        return false;
+
+    ring->slots[head & (SPSC_RING_SIZE - 1)] = item;
+    // Sequentially consistent against spsc_ring_sleep(): either the consumer sees the new head or we see
+    // it sleeping, never neither
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST))
+        fd_signal(ring->fd);
+    return true;
+}
+
+gpointer spsc_ring_pop(SpscRing *ring) {
+    guint tail = ring->tail;
+    if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    gpointer item = ring->slots[tail & (SPSC_RING_SIZE - 1)];
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    return item;
+}
+
+bool spsc_ring_sleep(SpscRing *ring) {
+    __atomic_store_n(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == ring->tail)
+        return true;
+
+    // Whatever arrived may have skipped the wakeup, keep draining instead
+    __atomic_store_n(&ring->sleeping, 0, __ATOMIC_RELAXED);
+    return false;
+}
+
+void spsc_ring_ack(SpscRing *ring) {
+    fd_ack(ring->fd);
+}
+
+void spsc_ring_signal_space(SpscRing *ring) {
+    // Pairs with the fence in spsc_ring_wait_space(): either the producer sees the tail we already
+    // published or we see it waiting
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->producer_waiting, __ATOMIC_RELAXED) &&
+        __atomic_exchange_n(&ring->producer_waiting, 0, __ATOMIC_ACQ_REL))
+        fd_signal(ring->space_fd);
+}
+
+bool spsc_ring_wait_space(SpscRing *ring) {
+    __atomic_store_n(&ring->producer_waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == SPSC_RING_SIZE)
+        return true;
+
+    // The consumer made room before it could see us waiting, push again instead
+    __atomic_store_n(&ring->producer_waiting, 0, __ATOMIC_RELAXED);
+    return false;
+}
+
+void spsc_ring_ack_space(SpscRing *ring) {
+    fd_ack(ring->space_fd);
+}
@@ -0,0 +1,43 @@
+#ifndef __SPSC_H__
+#define __SPSC_H__
+
+#include "glib.h"
+#include <stdbool.h>
+
+// Must be a power of two
+#define SPSC_RING_SIZE 1024
+
+// Bounded single producer, single consumer queue of pointers. Each side owns one index and only reads the
+// other, so neither ever takes a lock. The consumer waits on fd, which the producer only writes to after
+// the consumer announced with spsc_ring_sleep() that it found the ring empty. The other way round, a
+// producer that found the ring full announces it with spsc_ring_wait_space() and waits on space_fd, which
+// the consumer writes to from spsc_ring_signal_space() once it has taken items out.
+typedef struct {
+    gpointer slots[SPSC_RING_SIZE];
+    // Next slot the producer fills
+    guint head __attribute__((aligned(64)));
+    // Next slot the consumer takes
+    guint tail __attribute__((aligned(64)));
+    gint sleeping __attribute__((aligned(64)));
+    gint producer_waiting __attribute__((aligned(64)));
+    int fd;
+    int space_fd;
+} SpscRing;
+
+SpscRing *spsc_ring_new();
+void spsc_ring_free(SpscRing *ring);
+// Producer side, false when the ring is full
+bool spsc_ring_push(SpscRing *ring, gpointer item);
+// Consumer side, NULL when the ring is empty
+gpointer spsc_ring_pop(SpscRing *ring);
+// Consumer side, true when it may go back to waiting on fd, false when items arrived in the meantime
+bool spsc_ring_sleep(SpscRing *ring);
+// Consumer side, resets fd after it became readable
+void spsc_ring_ack(SpscRing *ring);
+// Consumer side, after popping: wakes a producer waiting for room
+void spsc_ring_signal_space(SpscRing *ring);
+// Producer side, after a failed push: true when it may wait on space_fd, false when room appeared meanwhile
+bool spsc_ring_wait_space(SpscRing *ring);
+// Producer side, resets space_fd after it became readable
+void spsc_ring_ack_space(SpscRing *ring);
+#endif
@@ -0,0 +1,259 @@
+// A fleet of synthetic MPRIS players for load testing awfulmc, driven by bench/run_bench.py.
+//
+// Every player gets its own bus connection, owns org.mpris.MediaPlayer2.fleet<N> and churns its state on
+// timers. Titles carry the CLOCK_MONOTONIC time (g_get_monotonic_time()) they were emitted at, so whoever
+// sees the change come out of awfulmc can compute the signal-to-state latency. Player 0 is the probe: it
+// never churns and only flips its status when told to PlayPause, which is what command round trips are
+// measured against, the harness starts it on its own first so it is the player awfulmc shows.
+#include <gio/gio.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MPRIS_PATH "/org/mpris/MediaPlayer2"
+#define MPRIS_PLAYER_INTERFACE "org.mpris.MediaPlayer2.Player"
+
+static const char introspection_xml[] =
+    "<node>"
+    "  <interface name='org.mpris.MediaPlayer2.Player'>"
+    "    <method name='PlayPause'/>"
+    "    <method name='Play'/>"
+    "    <method name='Pause'/>"
+    "    <method name='Next'/>"
+    "    <method name='Previous'/>"
+    "    <signal name='Seeked'><arg name='Position' type='x'/></signal>"
+    "    <property name='PlaybackStatus' type='s' access='read'/>"
+    "    <property name='LoopStatus' type='s' access='read'/>"
+    "    <property name='Rate' type='d' access='read'/>"
+    "    <property name='Shuffle' type='b' access='read'/>"
+    "    <property name='Metadata' type='a{sv}' access='read'/>"
+    "    <property name='Position' type='x' access='read'/>"
+    "    <property name='CanGoNext' type='b' access='read'/>"
+    "    <property name='CanGoPrevious' type='b' access='read'/>"
+    "    <property name='CanPlay' type='b' access='read'/>"
+    "    <property name='CanPause' type='b' access='read'/>"
+    "    <property name='CanControl' type='b' access='read'/>"
+    "  </interface>"
+    "</node>";
+
+typedef struct {
+    int index;
+    char *name;
+    GDBusConnection *con;
+    guint registration;
+    bool playing;
+    guint track;
+    gint64 stamp;
+    bool owned;
+} FleetPlayer;
+
+static int player_count = 10;
+static int first_index = 0;
+static double status_rate = 1.0;
+static double metadata_rate = 0.2;
+static double churn_rate = 0.0;
+static char *bus_address = NULL;
+
+static GOptionEntry entries[] = {
+    { "players", 'n', 0, G_OPTION_ARG_INT, &player_count, "Number of players (default 10)", "N" },
+    { "first", 'f', 0, G_OPTION_ARG_INT, &first_index, "Index of the first player (default 0)", "I" },
+    { "status-rate", 's', 0, G_OPTION_ARG_DOUBLE, &status_rate, "PlaybackStatus changes per second per player", "HZ" },
+    { "metadata-rate", 'm', 0, G_OPTION_ARG_DOUBLE, &metadata_rate, "Track changes per second per player", "HZ" },
+    { "churn-rate", 'c', 0, G_OPTION_ARG_DOUBLE, &churn_rate, "Name release/reacquire cycles per second per player", "HZ" },
+    { "address", 'a', 0, G_OPTION_ARG_STRING, &bus_address, "Bus address (default: the session bus)", "ADDR" },
+    { NULL }
+};
+
+static GVariant *build_metadata(FleetPlayer *player) {
+    GVariantBuilder md, artists;
+    g_variant_builder_init(&md, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_init(&artists, G_VARIANT_TYPE_STRING_ARRAY);
+    g_variant_builder_add(&artists, "s", "Fleet Artist");
+
+    char *trackid = g_strdup_printf(MPRIS_PATH "/Track/%u", player->track);
+    char *title = g_strdup_printf("t%" G_GINT64_FORMAT, player->stamp);
+    g_variant_builder_add(&md, "{sv}", "mpris:trackid", g_variant_new_object_path(trackid));
+    g_variant_builder_add(&md, "{sv}", "mpris:length", g_variant_new_int64(180 * G_USEC_PER_SEC));
+    g_variant_builder_add(&md, "{sv}", "xesam:title", g_variant_new_string(title));
+    g_variant_builder_add(&md, "{sv}", "xesam:artist", g_variant_builder_end(&artists));
+    g_variant_builder_add(&md, "{sv}", "xesam:album", g_variant_new_string(player->name));
+    g_free(trackid);
+    g_free(title);
+    return g_variant_builder_end(&md);
+}
+
+static GVariant *get_property(GDBusConnection *con, const gchar *sender, const gchar *object_path,
+                              const gchar *interface_name, const gchar *property_name, GError **error, gpointer user_data) {
+    FleetPlayer *player = user_data;
+
+    if (g_strcmp0(property_name, "PlaybackStatus") == 0)
+        return g_variant_new_string(player->playing ? "Playing" : "Paused");
+    if (g_strcmp0(property_name, "LoopStatus") == 0)
+        return g_variant_new_string("None");
+    if (g_strcmp0(property_name, "Rate") == 0)
+        return g_variant_new_double(1.0);
+    if (g_strcmp0(property_name, "Shuffle") == 0)
+        return g_variant_new_boolean(false);
+    if (g_strcmp0(property_name, "Metadata") == 0)
+        return build_metadata(player);
+    if (g_strcmp0(property_name, "Position") == 0)
+        return g_variant_new_int64(0);
+    // Every capability is on
+    return g_variant_new_boolean(true);
+}
+
+static void emit_properties_changed(FleetPlayer *player, const char *property, GVariant *value) {
+    GVariantBuilder changed;
+    g_variant_builder_init(&changed, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&changed, "{sv}", property, value);
+
+    GError *err = NULL;
+    g_dbus_connection_emit_signal(player->con, NULL, MPRIS_PATH, "org.freedesktop.DBus.Properties", "PropertiesChanged",
+                                  g_variant_new("(sa{sv}as)", MPRIS_PLAYER_INTERFACE, &changed, NULL), &err);
+    if (err != NULL) {
+        g_warning("%s: could not emit PropertiesChanged: %s", player->name, err->message);
+        g_error_free(err);
+    }
+}
+
+static void flip_status(FleetPlayer *player) {
+    player->playing = !player->playing;
+    emit_properties_changed(player, "PlaybackStatus", g_variant_new_string(player->playing ? "Playing" : "Paused"));
+}
+
+static void method_call(GDBusConnection *con, const gchar *sender, const gchar *object_path, const gchar *interface_name,
+                        const gchar *method_name, GVariant *parameters, GDBusMethodInvocation *invocation, gpointer user_data) {
+    FleetPlayer *player = user_data;
+
+    // awfulmc sends commands with NO_REPLY_EXPECTED, returning a value is still fine then
+    if (g_strcmp0(method_name, "PlayPause") == 0) {
+        flip_status(player);
+    } else if (g_strcmp0(method_name, "Next") == 0 || g_strcmp0(method_name, "Previous") == 0) {
+        player->track++;
+        player->stamp = g_get_monotonic_time();
+        emit_properties_changed(player, "Metadata", build_metadata(player));
+    }
+    g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static const GDBusInterfaceVTable vtable = { .method_call = method_call, .get_property = get_property };
+
+static bool request_name(FleetPlayer *player, bool own) {
+    GError *err = NULL;
+    GVariant *reply = g_dbus_connection_call_sync(player->con, "org.freedesktop.DBus", "/org/freedesktop/DBus",
+                                                  "org.freedesktop.DBus", own ? "RequestName" : "ReleaseName",
+                                                  own ? g_variant_new("(su)", player->name, 0) : g_variant_new("(s)", player->name),
+                                                  NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, &err);
+    if (reply == NULL) {
+        g_warning("%s: %s failed: %s", player->name, own ? "RequestName" : "ReleaseName", err->message);
+        g_error_free(err);
+        return false;
+    }
+    g_variant_unref(reply);
+    player->owned = own;
+    return true;
+}
+
+static gboolean status_tick(gpointer user_data) {
+    flip_status(user_data);
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean metadata_tick(gpointer user_data) {
+    FleetPlayer *player = user_data;
+    player->track++;
+    player->stamp = g_get_monotonic_time();
+    emit_properties_changed(player, "Metadata", build_metadata(player));
+    return G_SOURCE_CONTINUE;
+}
+
+// Dropping and taking the name back makes the bus send NameOwnerChanged twice, awfulmc forgets and
+// rediscovers the player each time
+static gboolean churn_tick(gpointer user_data) {
+    FleetPlayer *player = user_data;
+    request_name(player, !player->owned);
+    return G_SOURCE_CONTINUE;
+}
+
+static void add_timer(double rate, int index, GSourceFunc func, FleetPlayer *player) {
+    if (rate <= 0)
+        return;
+
+    // Spread the players over the period so their ticks do not all land at once
+    guint interval = MAX(1, (guint)(1000.0 / rate));
+    guint offset = interval * index / MAX(player_count, 1);
+    GSource *source = g_timeout_source_new(interval);
+    g_source_set_ready_time(source, g_get_monotonic_time() + (gint64)offset * 1000);
+    g_source_set_callback(source, func, player, NULL);
+    g_source_attach(source, NULL);
+    g_source_unref(source);
+}
+
+static FleetPlayer *fleet_player_new(int index, GDBusNodeInfo *info) {
+    GError *err = NULL;
+    GDBusConnection *con;
+    if (bus_address != NULL) {
+        con = g_dbus_connection_new_for_address_sync(bus_address,
+                                                     G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                     NULL, NULL, &err);
+    } else {
+        // g_bus_get_sync() would hand every player the same shared connection
+        char *address = g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SESSION, NULL, &err);
+        con = address == NULL ? NULL : g_dbus_connection_new_for_address_sync(address,
+                                                     G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                                     NULL, NULL, &err);
+        g_free(address);
+    }
+    if (con == NULL) {
+        g_printerr("could not connect to the bus: %s\n", err->message);
+        g_error_free(err);
+        return NULL;
+    }
+
+    FleetPlayer *player = calloc(1, sizeof(FleetPlayer));
+    player->index = index;
+    player->name = g_strdup_printf("org.mpris.MediaPlayer2.fleet%d", index);
+    player->con = con;
+    player->playing = index % 2 == 0;
+    player->stamp = g_get_monotonic_time();
+    player->registration = g_dbus_connection_register_object(con, MPRIS_PATH, info->interfaces[0], &vtable, player, NULL, &err);
+    if (player->registration == 0) {
+        g_printerr("could not export the player: %s\n", err->message);
+        g_error_free(err);
+        return NULL;
+    }
+    if (!request_name(player, true))
+        return NULL;
+    return player;
+}
+
+int main(int argc, char **argv) {
+    GError *err = NULL;
+    GOptionContext *options = g_option_context_new("- synthetic MPRIS players");
+    g_option_context_add_main_entries(options, entries, NULL);
+    if (!g_option_context_parse(options, &argc, &argv, &err)) {
+        g_printerr("%s\n", err->message);
+        return 1;
+    }
+    g_option_context_free(options);
+
+    GDBusNodeInfo *info = g_dbus_node_info_new_for_xml(introspection_xml, NULL);
+    for (int i = first_index; i < first_index + player_count; i++) {
+        FleetPlayer *player = fleet_player_new(i, info);
+        if (player == NULL)
+            return 1;
+        if (i == 0)
+            continue;
+        add_timer(status_rate, i, status_tick, player);
+        add_timer(metadata_rate, i, metadata_tick, player);
+        add_timer(churn_rate, i, churn_tick, player);
+    }
+
+    // The harness waits for this line before it starts measuring
+    printf("ready %d\n", player_count);
+    fflush(stdout);
+
+    GMainLoop *loop = g_main_loop_new(NULL, false);
+    g_main_loop_run(loop);
+    return 0;
+}
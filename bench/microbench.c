@@ -0,0 +1,347 @@
+// Microbenchmarks for the per-signal hot paths of awfulmc.
+//
+// Build and run with `make microbench`. Every decode case alternates between two payloads so each
+// iteration does real work instead of hitting the "nothing changed" fast path. Besides ns/op every case
+// reports allocations/op, counted by wrapping malloc() for the whole binary, glib included.
+#include "registry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_ITERATIONS 200000
+#define LOOKUP_PLAYERS 32
+
+// glibc's own entry points, what the wrappers below forward to
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+// volatile: the compiler treats malloc() as a builtin and would otherwise move the stores past the calls
+static volatile bool counting = false;
+static volatile long allocations = 0;
+
+void *malloc(size_t size) {
+    if (counting)
+        allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    if (counting)
+        allocations++;
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    if (counting)
+        allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+typedef struct {
+    double ns;
+    double allocs;
+} Result;
+
+static gint64 measure_start;
+
+static void measure_begin() {
+    allocations = 0;
+    counting = true;
+    measure_start = g_get_monotonic_time();
+}
+
+static Result measure_end(long iterations) {
+    gint64 elapsed = g_get_monotonic_time() - measure_start;
+    counting = false;
+    return (Result){ (elapsed * 1000.0) / iterations, (double)allocations / iterations };
+}
+
+static GVariant *build_metadata(const char *title, int artist_count, int extra_keys) {
+    GVariantBuilder md, artists;
+    g_variant_builder_init(&md, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_init(&artists, G_VARIANT_TYPE_STRING_ARRAY);
+
+    for (int i = 0; i < artist_count; i++) {
+        char *artist = g_strdup_printf("Artist Number %d With A Reasonably Long Name", i);
+        g_variant_builder_add(&artists, "s", artist);
+        g_free(artist);
+    }
+
+    g_variant_builder_add(&md, "{sv}", "mpris:trackid", g_variant_new_object_path("/org/mpris/MediaPlayer2/Track/1"));
+    g_variant_builder_add(&md, "{sv}", "mpris:length", g_variant_new_int64(215000000));
+    g_variant_builder_add(&md, "{sv}", "mpris:artUrl", g_variant_new_string("https://i.scdn.co/image/ab67616d0000b273"));
+    g_variant_builder_add(&md, "{sv}", "xesam:album", g_variant_new_string("Some Album"));
+    g_variant_builder_add(&md, "{sv}", "xesam:albumArtist", g_variant_new("as", NULL));
+    g_variant_builder_add(&md, "{sv}", "xesam:artist", g_variant_builder_end(&artists));
+    g_variant_builder_add(&md, "{sv}", "xesam:autoRating", g_variant_new_double(0.42));
+    g_variant_builder_add(&md, "{sv}", "xesam:discNumber", g_variant_new("i", 1));
+    g_variant_builder_add(&md, "{sv}", "xesam:title", g_variant_new_string(title));
+    g_variant_builder_add(&md, "{sv}", "xesam:trackNumber", g_variant_new("i", 7));
+    g_variant_builder_add(&md, "{sv}", "xesam:url", g_variant_new_string("https://open.spotify.com/track/0000000000"));
+
+    for (int i = 0; i < extra_keys; i++) {
+        char *key = g_strdup_printf("x-vendor:extra%03d", i);
+        g_variant_builder_add(&md, "{sv}", key, g_variant_new_string("some vendor specific value"));
+        g_free(key);
+    }
+
+    return g_variant_builder_end(&md);
+}
+
+// Payloads off the bus arrive serialized, which is the form both decoders have to walk
+static GVariant *as_wire(GVariant *value) {
+    GVariant *ref = g_variant_ref_sink(value);
+    GBytes *bytes = g_variant_get_data_as_bytes(ref);
+    GVariant *wire = g_variant_ref_sink(g_variant_new_from_bytes(g_variant_get_type(ref), bytes, TRUE));
+    g_bytes_unref(bytes);
+    g_variant_unref(ref);
+    return wire;
+}
+
+// Shaped like the GetAll reply Spotify sends for org.mpris.MediaPlayer2.Player
+static GVariant *build_get_all(const char *title, int artist_count, int extra_keys) {
+    GVariantBuilder props;
+    g_variant_builder_init(&props, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&props, "{sv}", "CanControl", g_variant_new_boolean(true));
+    g_variant_builder_add(&props, "{sv}", "CanGoNext", g_variant_new_boolean(true));
+    g_variant_builder_add(&props, "{sv}", "CanGoPrevious", g_variant_new_boolean(true));
+    g_variant_builder_add(&props, "{sv}", "CanPause", g_variant_new_boolean(true));
+    g_variant_builder_add(&props, "{sv}", "CanPlay", g_variant_new_boolean(true));
+    g_variant_builder_add(&props, "{sv}", "CanSeek", g_variant_new_boolean(true));
+    g_variant_builder_add(&props, "{sv}", "LoopStatus", g_variant_new_string("None"));
+    g_variant_builder_add(&props, "{sv}", "MaximumRate", g_variant_new_double(1.0));
+    g_variant_builder_add(&props, "{sv}", "Metadata", build_metadata(title, artist_count, extra_keys));
+    g_variant_builder_add(&props, "{sv}", "MinimumRate", g_variant_new_double(1.0));
+    g_variant_builder_add(&props, "{sv}", "PlaybackStatus", g_variant_new_string("Playing"));
+    g_variant_builder_add(&props, "{sv}", "Position", g_variant_new_int64(123456789));
+    g_variant_builder_add(&props, "{sv}", "Rate", g_variant_new_double(1.0));
+    g_variant_builder_add(&props, "{sv}", "Shuffle", g_variant_new_boolean(false));
+    g_variant_builder_add(&props, "{sv}", "Volume", g_variant_new_double(1.0));
+    return as_wire(g_variant_builder_end(&props));
+}
+
+// Hand-written payloads modelled on what these players send, not captures. They are in GVariant text form,
+// the a{sv} argument of PropertiesChanged as `gdbus monitor` prints it, so real captures can replace them.
+static const char *sample_payloads[][2] = {
+    // Firefox, track change on a video site
+    { "{'Metadata': <{'mpris:trackid': <objectpath '/org/mpris/MediaPlayer2/firefox'>, "
+      "'xesam:title': <'Some Video Title - Part 1'>, 'xesam:album': <''>, 'xesam:artist': <['Some Channel']>, "
+      "'mpris:artUrl': <'file:///tmp/firefox-mpris/1_0.png'>, 'mpris:length': <int64 613000000>}>, "
+      "'PlaybackStatus': <'Playing'>}",
+      "{'Metadata': <{'mpris:trackid': <objectpath '/org/mpris/MediaPlayer2/firefox'>, "
+      "'xesam:title': <'Some Video Title - Part 2'>, 'xesam:album': <''>, 'xesam:artist': <['Some Channel']>, "
+      "'mpris:artUrl': <'file:///tmp/firefox-mpris/1_1.png'>, 'mpris:length': <int64 587000000>}>, "
+      "'PlaybackStatus': <'Playing'>}" },
+    // mpv, pause and resume with the position that comes along
+    { "{'PlaybackStatus': <'Paused'>, 'Position': <int64 42000000>}",
+      "{'PlaybackStatus': <'Playing'>, 'Position': <int64 42001000>}" },
+    // Capability flip a browser sends when a page adds a playlist
+    { "{'CanGoNext': <true>, 'CanGoPrevious': <true>}",
+      "{'CanGoNext': <false>, 'CanGoPrevious': <false>}" },
+};
+
+static GVariant *parse_sample(const char *text) {
+    GError *err = NULL;
+    GVariant *value = g_variant_parse(G_VARIANT_TYPE_VARDICT, text, NULL, NULL, &err);
+    if (value == NULL) {
+        fprintf(stderr, "bad sample payload: %s\n", err->message);
+        exit(1);
+    }
+    return as_wire(value);
+}
+
+static GVariant *build_status_delta(const char *status) {
+    GVariantBuilder props;
+    g_variant_builder_init(&props, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&props, "{sv}", "PlaybackStatus", g_variant_new_string(status));
+    return as_wire(g_variant_builder_end(&props));
+}
+
+// The decoder awfulmc shipped before the table-driven one: a g_variant_lookup() per key. Strings are copied
+// like it did, as plain GRefStrings since player_free() releases them.
+static void legacy_update_string(char **field, const char *value) {
+    if (value != NULL && g_strcmp0(value, *field) != 0) {
+        if (*field != NULL)
+            g_ref_string_release(*field);
+        *field = g_ref_string_new(value);
+    }
+}
+
+static void legacy_set_flag(PlayerProperties *props, PlayerFlag flag, bool bv) {
+    props->flags = bv ? props->flags | flag : props->flags & ~flag;
+}
+
+static void legacy_update_player_properties(Player *player, GVariant *properties) {
+    PlayerProperties *props = player->player_properties;
+    const char *str;
+    bool bv;
+
+    if (g_variant_lookup(properties, "PlaybackStatus", "&s", &str))
+        props->playback_status = convert_to_playback_status(str);
+    if (g_variant_lookup(properties, "LoopStatus", "&s", &str))
+        props->loop_status = convert_to_loop_status(str);
+    if (g_variant_lookup(properties, "Shuffle", "b", &bv))
+        legacy_set_flag(props, PLAYER_FLAG_SHUFFLE, bv);
+
+    GVariant *metadata = g_variant_lookup_value(properties, "Metadata", G_VARIANT_TYPE_VARDICT);
+    if (metadata != NULL) {
+        if (g_variant_lookup(metadata, "xesam:title", "&s", &str))
+            legacy_update_string(&props->metadata->title, str);
+        if (g_variant_lookup(metadata, "xesam:album", "&s", &str))
+            legacy_update_string(&props->metadata->album, str);
+        GVariant *artists = g_variant_lookup_value(metadata, "xesam:artist", G_VARIANT_TYPE_STRING_ARRAY);
+        if (artists != NULL) {
+            GVariantIter iter;
+            g_variant_iter_init(&iter, artists);
+            if (g_variant_iter_next(&iter, "&s", &str))
+                legacy_update_string(&props->metadata->artist, str);
+            g_variant_unref(artists);
+        }
+        g_variant_unref(metadata);
+    }
+
+    if (g_variant_lookup(properties, "CanGoNext", "b", &bv))
+        legacy_set_flag(props, PLAYER_FLAG_CAN_GO_NEXT, bv);
+    if (g_variant_lookup(properties, "CanGoPrevious", "b", &bv))
+        legacy_set_flag(props, PLAYER_FLAG_CAN_GO_PREVIOUS, bv);
+    if (g_variant_lookup(properties, "CanPlay", "b", &bv))
+        legacy_set_flag(props, PLAYER_FLAG_CAN_PLAY, bv);
+    if (g_variant_lookup(properties, "CanPause", "b", &bv))
+        legacy_set_flag(props, PLAYER_FLAG_CAN_PAUSE, bv);
+    if (g_variant_lookup(properties, "CanControl", "b", &bv))
+        legacy_set_flag(props, PLAYER_FLAG_CAN_CONTROL, bv);
+}
+
+typedef struct {
+    const char *name;
+    GVariant *payload[2];
+} DecodeCase;
+
+static Result bench_decode(bool legacy, DecodeCase *c, long iterations) {
+    Player *player = player_new(":1.42", "spotify");
+    update_player_properties(player, c->payload[0]);
+
+    measure_begin();
+    for (long i = 0; i < iterations; i++) {
+        GVariant *payload = c->payload[i & 1];
+        if (legacy) {
+            legacy_update_player_properties(player, payload);
+        } else {
+            update_player_properties(player, payload);
+        }
+    }
+    Result result = measure_end(iterations);
+
+    player_free(player);
+    return result;
+}
+
+static const char *playback_statuses[] = { "Playing", "Paused", "Stopped" };
+static const char *loop_statuses[] = { "None", "Track", "Playlist", "Shuffle" };
+
+static Result bench_enums(bool loop, long iterations) {
+    // Summed so the compiler cannot drop the calls
+    volatile int sink = 0;
+    measure_begin();
+    for (long i = 0; i < iterations; i++) {
+        if (loop) {
+            sink += convert_to_loop_status(loop_statuses[i & 3]);
+        } else {
+            sink += convert_to_playback_status(playback_statuses[i % 3]);
+        }
+    }
+    return measure_end(iterations);
+}
+
+static void discard_log(const gchar *domain, GLogLevelFlags level, const gchar *message, gpointer user_data) {
+}
+
+// An unknown status warns every time, what is timed here is building that message and not printing it
+static Result bench_unknown_status(long iterations) {
+    volatile int sink = 0;
+    guint handler = g_log_set_handler(NULL, G_LOG_LEVEL_WARNING, discard_log, NULL);
+    // G_DEBUG=fatal-warnings would still abort after the handler ran
+    GLogLevelFlags fatal = g_log_set_always_fatal(G_LOG_FATAL_MASK);
+    measure_begin();
+    for (long i = 0; i < iterations; i++)
+        sink += convert_to_playback_status("Buffering");
+    Result result = measure_end(iterations);
+    g_log_set_always_fatal(fatal);
+    g_log_remove_handler(NULL, handler);
+    return result;
+}
+
+// What awfulmc did before the registry: a GList searched with player_compare() and a template player
+static Result bench_list_lookup(GList *players, char **uniques, long iterations) {
+    Player template = { 0 };
+    volatile int found = 0;
+    measure_begin();
+    for (long i = 0; i < iterations; i++) {
+        template.unique = uniques[i % LOOKUP_PLAYERS];
+        found += g_list_find_custom(players, &template, player_compare) != NULL;
+    }
+    return measure_end(iterations);
+}
+
+static Result bench_registry_lookup(PlayerRegistry *reg, char **uniques, long iterations) {
+    volatile int found = 0;
+    measure_begin();
+    for (long i = 0; i < iterations; i++) {
+        found += player_registry_find_unique(reg, uniques[i % LOOKUP_PLAYERS]) != NULL;
+    }
+    return measure_end(iterations);
+}
+
+static void print_result(const char *name, Result result) {
+    printf("%-36s %12.1f %12.2f\n", name, result.ns, result.allocs);
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : DEFAULT_ITERATIONS;
+
+    DecodeCase cases[] = {
+        { "status delta", { build_status_delta("Playing"), build_status_delta("Paused") } },
+        { "GetAll reply", { build_get_all("First Track", 2, 0), build_get_all("Second Track", 2, 0) } },
+        { "GetAll, large Metadata", { build_get_all("First Track", 100, 64), build_get_all("Second Track", 100, 64) } },
+        { "sample: firefox track", { parse_sample(sample_payloads[0][0]), parse_sample(sample_payloads[0][1]) } },
+        { "sample: mpv pause", { parse_sample(sample_payloads[1][0]), parse_sample(sample_payloads[1][1]) } },
+        { "sample: capabilities", { parse_sample(sample_payloads[2][0]), parse_sample(sample_payloads[2][1]) } },
+    };
+
+    printf("%-36s %12s %12s\n", "case", "ns/op", "allocs/op");
+    for (size_t i = 0; i < G_N_ELEMENTS(cases); i++) {
+        char *name = g_strdup_printf("decode lookup: %s", cases[i].name);
+        print_result(name, bench_decode(true, &cases[i], iterations));
+        g_free(name);
+        name = g_strdup_printf("decode table: %s", cases[i].name);
+        print_result(name, bench_decode(false, &cases[i], iterations));
+        g_free(name);
+        g_variant_unref(cases[i].payload[0]);
+        g_variant_unref(cases[i].payload[1]);
+    }
+
+    print_result("convert_to_playback_status", bench_enums(false, iterations));
+    print_result("convert_to_playback_status: unknown", bench_unknown_status(iterations));
+    print_result("convert_to_loop_status", bench_enums(true, iterations));
+
+    PlayerRegistry *reg = player_registry_new();
+    GList *players = NULL;
+    char *uniques[LOOKUP_PLAYERS];
+    for (int i = 0; i < LOOKUP_PLAYERS; i++) {
+        char *instance = g_strdup_printf("player%d.instance%d", i, i);
+        uniques[i] = g_strdup_printf(":1.%d", 100 + i);
+        Player *player = player_new(uniques[i], instance);
+        player_registry_add(reg, player);
+        players = g_list_append(players, player);
+        g_free(instance);
+    }
+    print_result("lookup: GList + player_compare", bench_list_lookup(players, uniques, iterations));
+    print_result("lookup: registry by unique", bench_registry_lookup(reg, uniques, iterations));
+    g_list_free(players);
+    player_registry_free(reg);
+    for (int i = 0; i < LOOKUP_PLAYERS; i++)
+        g_free(uniques[i]);
+
+    return 0;
+}
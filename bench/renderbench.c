@@ -0,0 +1,249 @@
+// Render benchmark and golden image check for the media box, no X server needed.
+//
+// Frames go through the same draw_media_box() the daemon uses, on the in-memory image backend.
+//   renderbench [iterations]                 time full and partial frames over a set of synthetic players
+//   renderbench --golden DIR                 render fixed scenes and compare them to DIR/<scene>.png
+//   renderbench --golden DIR --update        write the scenes to DIR instead
+// Goldens depend on the installed fonts, regenerate them when those change.
+#include "mediabox.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_ITERATIONS 2000
+#define BENCH_PLAYERS 32
+
+// Clicks never reach a headless box, these only satisfy the buttons
+void send_prev(void *data) {}
+void send_next(void *data) {}
+void send_play_pause(void *data) {}
+void rotate_shown_player_prev(void *data) {}
+void rotate_shown_player_next(void *data) {}
+
+static const char *titles[] = {
+    "Short",
+    "A Considerably Longer Track Title That Will Not Fit In The Box At All",
+    "Ünïcödé — 日本語のタイトル",
+    "Intro (Live at the Royal Albert Hall, 1997 Remaster)",
+};
+
+static GVariant *build_properties(const char *title, const char *artist, const char *album, const char *status) {
+    GVariantBuilder md, artists, props;
+    g_variant_builder_init(&artists, G_VARIANT_TYPE_STRING_ARRAY);
+    g_variant_builder_add(&artists, "s", artist);
+    g_variant_builder_init(&md, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&md, "{sv}", "xesam:title", g_variant_new_string(title));
+    g_variant_builder_add(&md, "{sv}", "xesam:artist", g_variant_builder_end(&artists));
+    g_variant_builder_add(&md, "{sv}", "xesam:album", g_variant_new_string(album));
+    g_variant_builder_add(&md, "{sv}", "mpris:length", g_variant_new_int64(245 * G_USEC_PER_SEC));
+
+    g_variant_builder_init(&props, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&props, "{sv}", "PlaybackStatus", g_variant_new_string(status));
+    g_variant_builder_add(&props, "{sv}", "CanGoNext", g_variant_new_boolean(true));
+    g_variant_builder_add(&props, "{sv}", "CanGoPrevious", g_variant_new_boolean(true));
+    g_variant_builder_add(&props, "{sv}", "CanPlay", g_variant_new_boolean(true));
+    g_variant_builder_add(&props, "{sv}", "CanPause", g_variant_new_boolean(true));
+    g_variant_builder_add(&props, "{sv}", "Metadata", g_variant_builder_end(&md));
+    // Paused at a fixed position keeps the progress widget identical from run to run
+    g_variant_builder_add(&props, "{sv}", "Position", g_variant_new_int64(83 * G_USEC_PER_SEC));
+    return g_variant_ref_sink(g_variant_builder_end(&props));
+}
+
+static Player *add_player(PlayerRegistry *reg, int index, const char *title, const char *status) {
+    char *instance = g_strdup_printf("player%d.instance%d", index, index);
+    char *unique = g_strdup_printf(":1.%d", index);
+    char *artist = g_strdup_printf("Artist %d", index);
+    char *album = g_strdup_printf("Album Number %d", index);
+
+    Player *player = player_new(unique, instance);
+    GVariant *props = build_properties(title, artist, album, status);
+    update_player_properties(player, props);
+    g_variant_unref(props);
+    player->state = PLAYER_STATE_LIVE;
+    player_registry_add(reg, player);
+    player_registry_set_live(reg, player);
+
+    g_free(instance);
+    g_free(unique);
+    g_free(artist);
+    g_free(album);
+    return player;
+}
+
+static double elapsed_ns(gint64 start, long iterations) {
+    return (double)(g_get_monotonic_time() - start) * 1000.0 / iterations;
+}
+
+static void bench(long iterations) {
+    PlayerRegistry *reg = player_registry_new();
+    for (int i = 0; i < BENCH_PLAYERS; i++)
+        add_player(reg, i, titles[i % G_N_ELEMENTS(titles)], "Playing");
+    MediaBoxContext *mbc = media_box_context_new(reg, &media_box_image_backend);
+
+    // Switching players repaints everything
+    draw_media_box(mbc, reg);
+    gint64 start = g_get_monotonic_time();
+    for (long i = 0; i < iterations; i++) {
+        mbc->shown_player = player_registry_next(reg, mbc->shown_player);
+        draw_media_box(mbc, reg);
+    }
+    double full = elapsed_ns(start, iterations);
+
+    // A title change on the shown player, the common case while a box is open
+    Player *player = mbc->shown_player;
+    char title[64];
+    start = g_get_monotonic_time();
+    for (long i = 0; i < iterations; i++) {
+        snprintf(title, sizeof(title), "Track %ld", i);
+        g_ref_string_release(player->player_properties->metadata->title);
+        player->player_properties->metadata->title = g_ref_string_new_intern(title);
+        media_box_damage(mbc, media_box_damage_for_changes(PLAYER_CHANGED_TITLE));
+        draw_media_box(mbc, reg);
+    }
+    double title_frame = elapsed_ns(start, iterations);
+
+    // Only the progress widget, what a playing box does every second
+    start = g_get_monotonic_time();
+    for (long i = 0; i < iterations; i++) {
+        media_box_damage(mbc, DAMAGE(WIDGET_PROGRESS));
+        draw_media_box(mbc, reg);
+    }
+    double progress_frame = elapsed_ns(start, iterations);
+
+    printf("%-28s %14s %10s\n", "draw_media_box", "ns/frame", "fps");
+    printf("%-28s %14.0f %10.0f\n", "full (player switch)", full, 1e9 / full);
+    printf("%-28s %14.0f %10.0f\n", "title change", title_frame, 1e9 / title_frame);
+    printf("%-28s %14.0f %10.0f\n", "progress tick", progress_frame, 1e9 / progress_frame);
+
+    media_box_context_free(mbc);
+    player_registry_free(reg);
+}
+
+typedef struct {
+    const char *name;
+    int players;
+    int title;
+    const char *status;
+} Scene;
+
+static const Scene scenes[] = {
+    { "no-players", 0, 0, NULL },
+    { "single-paused", 1, 0, "Paused" },
+    { "long-title", 1, 1, "Paused" },
+    { "unicode", 1, 2, "Paused" },
+    { "carousel", 3, 3, "Stopped" },
+};
+
+// Counts pixels that differ in any channel by more than tolerance
+static long compare_surfaces(cairo_surface_t *a, cairo_surface_t *b, int tolerance) {
+    if (cairo_image_surface_get_width(a) != cairo_image_surface_get_width(b) ||
+        cairo_image_surface_get_height(a) != cairo_image_surface_get_height(b))
+        return -1;
+
+    cairo_surface_flush(a);
+    cairo_surface_flush(b);
+    int width = cairo_image_surface_get_width(a);
+    int height = cairo_image_surface_get_height(a);
+    long differing = 0;
+    for (int y = 0; y < height; y++) {
+        const uint32_t *row_a = (const uint32_t *)(cairo_image_surface_get_data(a) + y * cairo_image_surface_get_stride(a));
+        const uint32_t *row_b = (const uint32_t *)(cairo_image_surface_get_data(b) + y * cairo_image_surface_get_stride(b));
+        for (int x = 0; x < width; x++) {
+            // RGB24 leaves the top byte undefined, only compare the colour channels
+            for (int shift = 0; shift < 24; shift += 8) {
+                int ca = (row_a[x] >> shift) & 0xff;
+                int cb = (row_b[x] >> shift) & 0xff;
+                if (abs(ca - cb) > tolerance) {
+                    differing++;
+                    break;
+                }
+            }
+        }
+    }
+    return differing;
+}
+
+static int golden(const char *dir, bool update, int tolerance) {
+    // Goldens depend on the fonts installed, they are generated locally rather than shipped
+    if (!update && !g_file_test(dir, G_FILE_TEST_IS_DIR)) {
+        fprintf(stderr, "no golden images in %s, run make golden-update first\n", dir);
+        return 2;
+    }
+
+    int failures = 0;
+    for (size_t s = 0; s < G_N_ELEMENTS(scenes); s++) {
+        const Scene *scene = &scenes[s];
+        PlayerRegistry *reg = player_registry_new();
+        for (int i = 0; i < scene->players; i++)
+            add_player(reg, i, titles[(scene->title + i) % G_N_ELEMENTS(titles)], scene->status);
+        MediaBoxContext *mbc = media_box_context_new(reg, &media_box_image_backend);
+        draw_media_box(mbc, reg);
+
+        char *path = g_strdup_printf("%s/%s.png", dir, scene->name);
+        if (update) {
+            if (cairo_surface_write_to_png(mbc->back_buffer, path) != CAIRO_STATUS_SUCCESS) {
+                fprintf(stderr, "could not write %s\n", path);
+                failures++;
+            } else {
+                printf("wrote %s\n", path);
+            }
+        } else {
+            cairo_surface_t *expected = cairo_image_surface_create_from_png(path);
+            long differing = -1;
+            if (cairo_surface_status(expected) == CAIRO_STATUS_SUCCESS) {
+                // PNGs load as ARGB32, draw ours onto the same format so both are compared alike
+                cairo_surface_t *actual = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, WIDTH, HEIGHT);
+                cairo_t *cr = cairo_create(actual);
+                cairo_set_source_surface(cr, mbc->back_buffer, 0, 0);
+                cairo_paint(cr);
+                cairo_destroy(cr);
+                differing = compare_surfaces(actual, expected, tolerance);
+                cairo_surface_destroy(actual);
+            }
+            cairo_surface_destroy(expected);
+
+            if (differing != 0) {
+                char *actual_path = g_strdup_printf("%s/%s.actual.png", dir, scene->name);
+                cairo_surface_write_to_png(mbc->back_buffer, actual_path);
+                if (differing < 0)
+                    printf("FAIL %-16s missing or unreadable golden, wrote %s\n", scene->name, actual_path);
+                else
+                    printf("FAIL %-16s %ld pixels differ, wrote %s\n", scene->name, differing, actual_path);
+                g_free(actual_path);
+                failures++;
+            } else {
+                printf("ok   %s\n", scene->name);
+            }
+        }
+
+        g_free(path);
+        media_box_context_free(mbc);
+        player_registry_free(reg);
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    const char *golden_dir = NULL;
+    bool update = false;
+    int tolerance = 0;
+    long iterations = DEFAULT_ITERATIONS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+            golden_dir = argv[++i];
+        } else if (strcmp(argv[i], "--update") == 0) {
+            update = true;
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atoi(argv[++i]);
+        } else {
+            iterations = atol(argv[i]);
+        }
+    }
+
+    if (golden_dir != NULL)
+        return golden(golden_dir, update, tolerance);
+
+    bench(iterations);
+    return 0;
+}
@@ -0,0 +1,320 @@
+#!/usr/bin/env python3
+"""Load test awfulmc against a fleet of synthetic MPRIS players.
+
+Everything runs in private instances: a dbus-daemon session bus, an Xvfb display, and awfulmc on its own
+control socket and shm name, so it is safe to run next to a real session. Run it through `make bench`,
+extra options go in BENCH_ARGS, e.g. `make bench BENCH_ARGS="--players 50 --metadata-rate 2"`.
+
+Measured over the --duration window:
+  * CPU time, wakeups (voluntary context switches) and RSS of the awfulmc process, from /proc
+  * signal-to-state latency: fleet titles carry the monotonic time they were emitted at, the difference
+    to when the UPDATE for them arrives on a SUBSCRIBE connection
+  * command round trip: PLAYPAUSE on the control socket until the probe player's status UPDATE comes back
+"""
+
+import argparse
+import json
+import os
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+CLOCK_TICKS = os.sysconf("SC_CLK_TCK")
+
+
+def now_us():
+    # CLOCK_MONOTONIC, the clock g_get_monotonic_time() reads
+    return time.monotonic_ns() // 1000
+
+
+def percentile(values, fraction):
+    if not values:
+        return float("nan")
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def summarize(values):
+    return {
+        "count": len(values),
+        "p50_us": percentile(values, 0.50),
+        "p95_us": percentile(values, 0.95),
+        "p99_us": percentile(values, 0.99),
+        "max_us": max(values) if values else float("nan"),
+    }
+
+
+def read_status(path):
+    status = {}
+    with open(path) as f:
+        for line in f:
+            key, _, value = line.partition(":")
+            status[key] = value.split()[0] if value.split() else ""
+    return status
+
+
+class ProcSample:
+    """CPU time and context switches per thread, the bus thread does as much work as the main one."""
+
+    def __init__(self, pid):
+        self.tasks = {}
+        for tid in os.listdir(f"/proc/{pid}/task"):
+            try:
+                with open(f"/proc/{pid}/task/{tid}/stat") as f:
+                    # The command name may contain spaces, the fields we want come after its closing parenthesis
+                    fields = f.read().rsplit(")", 1)[1].split()
+                status = read_status(f"/proc/{pid}/task/{tid}/status")
+            except FileNotFoundError:
+                # Exited between listing and reading
+                continue
+            self.tasks[tid] = {
+                "cpu": (int(fields[11]) + int(fields[12])) / CLOCK_TICKS,
+                "wakeups": int(status.get("voluntary_ctxt_switches", 0)),
+                "preempted": int(status.get("nonvoluntary_ctxt_switches", 0)),
+            }
+        status = read_status(f"/proc/{pid}/status")
+        self.rss_kb = int(status.get("VmRSS", 0))
+        self.hwm_kb = int(status.get("VmHWM", 0))
+        self.time = time.monotonic()
+
+    def since(self, before, counter):
+        """Growth of a counter summed over the threads alive now, threads started in between count from zero.
+        Threads that exited in between are lost, which undercounts rather than going negative."""
+        return sum(task[counter] - before.tasks.get(tid, {}).get(counter, 0) for tid, task in self.tasks.items())
+
+
+class Subscriber(threading.Thread):
+    """Reads the control socket: replies go to a queue, events are timestamped as they arrive."""
+
+    def __init__(self, path):
+        super().__init__(daemon=True)
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(path)
+        self.lock = threading.Condition()
+        self.replies = []
+        self.live = set()
+        self.status = {}
+        self.signal_latencies = []
+        self.dropped = 0
+        self.measuring = False
+
+    def send(self, command):
+        self.sock.sendall(command.encode() + b"\n")
+
+    def command(self, command, timeout=5.0):
+        with self.lock:
+            self.replies.clear()
+        self.send(command)
+        with self.lock:
+            if not self.lock.wait_for(lambda: self.replies, timeout):
+                raise RuntimeError(f"no reply to {command}")
+            return self.replies.pop(0)
+
+    def wait_for(self, predicate, timeout):
+        with self.lock:
+            return self.lock.wait_for(predicate, timeout)
+
+    def run(self):
+        buffered = b""
+        while True:
+            data = self.sock.recv(65536)
+            if not data:
+                return
+            received = now_us()
+            buffered += data
+            *lines, buffered = buffered.split(b"\n")
+            with self.lock:
+                for line in lines:
+                    self.handle(line.decode(errors="replace").split("\t"), received)
+                self.lock.notify_all()
+
+    def handle(self, fields, received):
+        kind = fields[0]
+        if kind == "OK" or kind.startswith("ERR"):
+            self.replies.append(kind)
+        elif kind == "ADDED":
+            self.live.add(fields[1])
+        elif kind == "REMOVED":
+            self.live.discard(fields[1])
+        elif kind == "DROPPED":
+            self.dropped += int(fields[1])
+        elif kind == "UPDATE":
+            instance = fields[1]
+            for field in fields[2:]:
+                key, _, value = field.partition("=")
+                if key == "status":
+                    self.status[instance] = (value, received)
+                elif key == "title" and value.startswith("t") and self.measuring:
+                    self.signal_latencies.append(received - int(value[1:]))
+
+
+def wait_for_path(path, proc, timeout=10.0):
+    deadline = time.monotonic() + timeout
+    while not os.path.exists(path):
+        if proc.poll() is not None:
+            raise RuntimeError(f"{proc.args[0]} exited with {proc.returncode}")
+        if time.monotonic() > deadline:
+            raise RuntimeError(f"timed out waiting for {path}")
+        time.sleep(0.01)
+
+
+def start_fleet(args, address, first, count, rates):
+    proc = subprocess.Popen(
+        [args.fleet, "--address", address, "--first", str(first), "--players", str(count),
+         "--status-rate", str(rates[0]), "--metadata-rate", str(rates[1]), "--churn-rate", str(rates[2])],
+        stdout=subprocess.PIPE, text=True)
+    line = proc.stdout.readline()
+    if not line.startswith("ready"):
+        raise RuntimeError("fleet failed to start")
+    return proc
+
+
+def measure_commands(sub, args):
+    """PLAYPAUSE round trips against the probe player, fleet0, named explicitly so the target does not depend on
+    what the media box shows or which player started playing last."""
+    round_trips = []
+    acks = []
+    interval = 1.0 / args.command_rate if args.command_rate > 0 else None
+    deadline = time.monotonic() + args.duration
+    while interval is not None and time.monotonic() < deadline:
+        with sub.lock:
+            previous = sub.status.get("fleet0")
+        sent = now_us()
+        reply = sub.command("PLAYPAUSE fleet0")
+        acks.append(now_us() - sent)
+        if reply != "OK":
+            raise RuntimeError(f"PLAYPAUSE failed: {reply}")
+        if sub.wait_for(lambda: sub.status.get("fleet0") != previous, 2.0):
+            round_trips.append(sub.status["fleet0"][1] - sent)
+        time.sleep(interval)
+    remaining = deadline - time.monotonic()
+    if remaining > 0:
+        time.sleep(remaining)
+    return acks, round_trips
+
+
+def run(args):
+    for tool in ("dbus-daemon", "Xvfb"):
+        if shutil.which(tool) is None:
+            sys.exit(f"{tool} is required to run the benchmark")
+
+    tmp = tempfile.mkdtemp(prefix="awfulmc-bench-")
+    procs = []
+    try:
+        bus = subprocess.Popen(["dbus-daemon", "--session", "--nofork", "--print-address=1",
+                                f"--address=unix:dir={tmp}"], stdout=subprocess.PIPE, text=True)
+        procs.append(bus)
+        address = bus.stdout.readline().strip()
+
+        display = args.display
+        xvfb = subprocess.Popen(["Xvfb", f":{display}", "-nolisten", "tcp", "-screen", "0", "1280x800x24"],
+                                stderr=subprocess.DEVNULL)
+        procs.append(xvfb)
+        wait_for_path(f"/tmp/.X11-unix/X{display}", xvfb)
+
+        socket_path = os.path.join(tmp, "awfulmc.sock")
+        env = dict(os.environ, DBUS_SESSION_BUS_ADDRESS=address, DISPLAY=f":{display}",
+                   AWFULMC_SOCKET=socket_path, AWFULMC_SHM=f"/awfulmc-bench-{os.getpid()}")
+        env.pop("G_MESSAGES_DEBUG", None)
+        daemon = subprocess.Popen([args.awfulmc], env=env, stdout=subprocess.DEVNULL)
+        procs.append(daemon)
+        wait_for_path(socket_path, daemon)
+
+        sub = Subscriber(socket_path)
+        sub.start()
+        if sub.command("SUBSCRIBE") != "OK":
+            raise RuntimeError("SUBSCRIBE failed")
+
+        procs.append(start_fleet(args, address, 0, 1, (0, 0, 0)))
+        if not sub.wait_for(lambda: "fleet0" in sub.live, 10.0):
+            raise RuntimeError("awfulmc never picked up the probe player")
+        if args.players > 1:
+            rates = (args.status_rate, args.metadata_rate, args.churn_rate)
+            procs.append(start_fleet(args, address, 1, args.players - 1, rates))
+            # With name churn some players are legitimately gone at any moment
+            expected = args.players if args.churn_rate == 0 else 1
+            if not sub.wait_for(lambda: len(sub.live) >= expected, 30.0):
+                raise RuntimeError(f"only {len(sub.live)} of {args.players} players showed up")
+        if sub.command("TOGGLE") != "OK":
+            raise RuntimeError("TOGGLE failed")
+        time.sleep(args.warmup)
+
+        before = ProcSample(daemon.pid)
+        sub.measuring = True
+        acks, round_trips = measure_commands(sub, args)
+        sub.measuring = False
+        after = ProcSample(daemon.pid)
+
+        elapsed = after.time - before.time
+        with sub.lock:
+            signal_latencies = list(sub.signal_latencies)
+        results = {
+            "config": {
+                "players": args.players, "status_rate": args.status_rate, "metadata_rate": args.metadata_rate,
+                "churn_rate": args.churn_rate, "duration": elapsed,
+            },
+            "cpu_percent": 100.0 * after.since(before, "cpu") / elapsed,
+            "wakeups_per_sec": after.since(before, "wakeups") / elapsed,
+            "preemptions_per_sec": after.since(before, "preempted") / elapsed,
+            "rss_kb": after.rss_kb,
+            "peak_rss_kb": after.hwm_kb,
+            "signal_to_state": summarize(signal_latencies),
+            "command_ack": summarize(acks),
+            "command_round_trip": summarize(round_trips),
+            "events_dropped": sub.dropped,
+        }
+        return results
+    finally:
+        for proc in reversed(procs):
+            if proc.poll() is None:
+                proc.send_signal(signal.SIGTERM)
+                try:
+                    proc.wait(timeout=5)
+                except subprocess.TimeoutExpired:
+                    proc.kill()
+        shutil.rmtree(tmp, ignore_errors=True)
+
+
+def print_results(results):
+    config = results["config"]
+    print(f"players={config['players']} status={config['status_rate']}Hz metadata={config['metadata_rate']}Hz "
+          f"churn={config['churn_rate']}Hz over {config['duration']:.1f}s")
+    print(f"  cpu          {results['cpu_percent']:8.2f} %")
+    print(f"  wakeups      {results['wakeups_per_sec']:8.1f} /s  ({results['preemptions_per_sec']:.1f} /s preempted)")
+    print(f"  rss          {results['rss_kb']:8d} kB  (peak {results['peak_rss_kb']} kB)")
+    print(f"  dropped      {results['events_dropped']:8d} events")
+    print(f"  {'latency':<20} {'n':>7} {'p50':>9} {'p95':>9} {'p99':>9} {'max':>9}  (us)")
+    for name in ("signal_to_state", "command_ack", "command_round_trip"):
+        s = results[name]
+        print(f"  {name:<20} {s['count']:7d} {s['p50_us']:9.0f} {s['p95_us']:9.0f} {s['p99_us']:9.0f} {s['max_us']:9.0f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--awfulmc", default="build/awfulmc")
+    parser.add_argument("--fleet", default="build/fleet")
+    parser.add_argument("--players", type=int, default=20)
+    parser.add_argument("--status-rate", type=float, default=1.0, help="status flips per second per player")
+    parser.add_argument("--metadata-rate", type=float, default=0.5, help="track changes per second per player")
+    parser.add_argument("--churn-rate", type=float, default=0.0, help="name drop/reacquire cycles per second per player")
+    parser.add_argument("--command-rate", type=float, default=20.0, help="PLAYPAUSE round trips per second")
+    parser.add_argument("--duration", type=float, default=10.0)
+    parser.add_argument("--warmup", type=float, default=1.0)
+    parser.add_argument("--display", type=int, default=97)
+    parser.add_argument("--json", help="also write the results to this file")
+    args = parser.parse_args()
+
+    results = run(args)
+    print_results(results)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(results, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()